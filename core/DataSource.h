@@ -22,16 +22,33 @@
 #include <functional>
 
 #include "SearchItem.h"
+#include "SearchQuery.h"
+#include "SearchToken.h"
 
 using namespace std;
 
+/**
+ * Interface of plugins (v1).
+ *
+ * It's installed for plugins, don't change its layout and virtual functions,
+ * plugins built with older headers are loaded also. Newer interfaces are
+ * subclasses of it, they're found by dynamic_cast (see getApiVersion()).
+ */
 class DataSource {
 public:
+    // 1: search(key)
+    // 2: search(query), search(query, token), refine() of DataSourceV2
+    // 3: searchChunks(query, token) of DataSourceV3
+    static const int API_VERSION = 3;
+
     DataSource(const string& id) : m_id(id) {}
     virtual ~DataSource() {}
 
     string getId() { return m_id; }
 
+    // the newest interface the source implements
+    int getApiVersion();
+
     using searchCB = function<void(string, vector<SearchItemPtr>)>;
     virtual bool search(const string& searchKey, searchCB callback) = 0;
 
@@ -39,6 +56,88 @@ private:
     string m_id;
 };
 
+/**
+ * Don't add virtual functions or members here also, add DataSourceV4 for them.
+ */
+class DataSourceV2 : public DataSource {
+public:
+    DataSourceV2(const string& id) : DataSource(id) {}
+    virtual ~DataSourceV2() {}
+
+    using DataSource::search;
+
+    // called whenever its data is changed (e.g. to invalidate cached results)
+    using changedCB = function<void(const string& sourceId)>;
+    void setChangedCallback(changedCB callback) { m_changedCB = std::move(callback); }
+
+    // search only on the categories of the query (by default, search all and caller filters them)
+    virtual bool search(SearchQueryPtr query, searchCB callback) { return search(query->getKey(), std::move(callback)); }
+
+    // stop the work when the token is cancelled or expired, nobody waits its result then
+    // (by default, it runs to the end and the result is ignored)
+    virtual bool search(SearchQueryPtr query, SearchTokenPtr token, searchCB callback) { return search(query, std::move(callback)); }
+
+    // filter previous items (found by a prefix of the key) on memory, instead of searching again
+    // false if it can't tell exactly same result with search (then, it's searched again)
+    virtual bool refine(const string& key, const vector<SearchItemPtr>& items, vector<bool>& matched) { return false; }
+
+protected:
+    void notifyChanged()
+    {
+        if (m_changedCB) {
+            m_changedCB(getId());
+        }
+    }
+
+private:
+    changedCB m_changedCB;
+};
+
+class DataSourceV3 : public DataSourceV2 {
+public:
+    DataSourceV3(const string& id) : DataSourceV2(id) {}
+    virtual ~DataSourceV3() {}
+
+    using DataSourceV2::search;
+
+    // give items in parts as soon as they're ready, the last part has 'done' (it can be empty)
+    // and 'failed' if some of items couldn't be searched (e.g. service error), not to keep the result.
+    // 'cursors' are positions of each item on the source to resume after it (empty if not supported)
+    using chunkCB = function<void(const string& sourceId, vector<SearchItemPtr> items, vector<string> cursors, bool done, bool failed)>;
+    virtual bool searchChunks(SearchQueryPtr query, SearchTokenPtr token, chunkCB callback)
+    {
+        return search(query, token, [callback] (string sourceId, vector<SearchItemPtr> items) {
+            callback(sourceId, std::move(items), vector<string>(), true, false);
+        });
+    }
+
+protected:
+    // for sources giving parts, all items at once for older interfaces
+    static chunkCB collect(searchCB callback)
+    {
+        auto collected = make_shared<vector<SearchItemPtr>>();
+        return [collected, callback] (const string& sourceId, vector<SearchItemPtr> items, vector<string> cursors, bool done, bool failed) {
+            collected->insert(collected->end(), items.begin(), items.end());
+            if (done) {
+                callback(sourceId, std::move(*collected));
+            }
+        };
+    }
+};
+
+inline int DataSource::getApiVersion()
+{
+    if (dynamic_cast<DataSourceV3*>(this)) {
+        return 3;
+    }
+    if (dynamic_cast<DataSourceV2*>(this)) {
+        return 2;
+    }
+    return 1;
+}
+
 typedef shared_ptr<DataSource> DataSourcePtr;
+typedef shared_ptr<DataSourceV2> DataSourceV2Ptr;
+typedef shared_ptr<DataSourceV3> DataSourceV3Ptr;
 
 #endif /* BASE_DATASOURCE_H_ */
@@ -55,7 +55,8 @@ public:
     template<typename ... Args>
     static const string format(const string& fmt, Args ... args)
     {
-        static char buffer[1024];
+        // indexer thread also formats logs
+        static thread_local char buffer[1024];
         snprintf(buffer, 1024, fmt.c_str(), args ... );
         return string(buffer);
     }
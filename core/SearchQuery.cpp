@@ -0,0 +1,49 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "SearchQuery.h"
+
+#include <algorithm>
+
+SearchQuery::SearchQuery(const string& key)
+    : m_key(key)
+    , m_limit(0)
+    , m_maxItems(0)
+    , m_offset(0)
+    , m_timeout(0)
+{
+}
+
+void SearchQuery::addCategory(const string& cateId)
+{
+    if (find(m_categories.begin(), m_categories.end(), cateId) == m_categories.end()) {
+        m_categories.push_back(cateId);
+    }
+}
+
+bool SearchQuery::isTarget(const string& cateId)
+{
+    return m_categories.empty() || find(m_categories.begin(), m_categories.end(), cateId) != m_categories.end();
+}
+
+string SearchQuery::getCursor(const string& sourceId)
+{
+    auto it = m_cursors.find(sourceId);
+    if (it == m_cursors.end()) {
+        return "";
+    }
+    return it->second;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef BASE_CORE_SEARCHQUERY_H_
+#define BASE_CORE_SEARCHQUERY_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class SearchQuery {
+public:
+    SearchQuery(const string& key);
+    virtual ~SearchQuery() {}
+
+    const string& getKey() { return m_key; }
+
+    // limit the search to given categories in rank order, nothing added means all categories
+    void addCategory(const string& cateId);
+    const vector<string>& getCategories() { return m_categories; }
+    bool isTarget(const string& cateId);
+
+    // the number of items in total, and per category (0 = no limit)
+    void setLimit(int limit) { m_limit = limit; }
+    int getLimit() { return m_limit; }
+    void setMaxItems(int maxItems) { m_maxItems = maxItems; }
+    int getMaxItems() { return m_maxItems; }
+
+    // the number of items to skip from the first (or from the cursors)
+    void setOffset(int offset) { m_offset = offset; }
+    int getOffset() { return m_offset; }
+
+    // per source position to resume after, given with items by DataSourceV3::searchChunks()
+    void setCursor(const string& sourceId, const string& cursor) { m_cursors[sourceId] = cursor; }
+    string getCursor(const string& sourceId);
+    const map<string, string>& getCursors() { return m_cursors; }
+
+    // milliseconds to wait results (0 = default)
+    void setTimeout(int timeout) { m_timeout = timeout; }
+    int getTimeout() { return m_timeout; }
+
+    // who searches (e.g. sender of the request), to refine its previous results
+    void setSession(const string& session) { m_session = session; }
+    const string& getSession() { return m_session; }
+
+private:
+    string m_key;
+    vector<string> m_categories;
+    int m_limit;
+    int m_maxItems;
+    int m_offset;
+    int m_timeout;
+    map<string, string> m_cursors;
+    string m_session;
+};
+
+typedef shared_ptr<SearchQuery> SearchQueryPtr;
+
+#endif /* BASE_SEARCHQUERY_H_ */
@@ -0,0 +1,64 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "SearchToken.h"
+
+#include <glib.h>
+
+SearchToken::SearchToken(int timeout)
+    : m_cancelled(false)
+    , m_deadline(timeout > 0 ? g_get_monotonic_time() + timeout * 1000LL : 0)
+{
+}
+
+void SearchToken::cancel()
+{
+    if (m_cancelled) {
+        return;
+    }
+    m_cancelled = true;
+
+    // each handler is called only once
+    auto handlers = std::move(m_handlers);
+    m_handlers.clear();
+    for (auto& handler : handlers) {
+        handler();
+    }
+}
+
+bool SearchToken::isCancelled()
+{
+    return m_cancelled || (m_deadline > 0 && g_get_monotonic_time() >= m_deadline);
+}
+
+int SearchToken::getRemaining()
+{
+    if (m_deadline <= 0) {
+        return -1;
+    }
+    long long remaining = (m_deadline - g_get_monotonic_time()) / 1000;
+    return remaining > 0 ? (int) remaining : 0;
+}
+
+void SearchToken::onCancelled(function<void()> handler)
+{
+    if (m_cancelled) {
+        handler();
+        return;
+    }
+    m_handlers.push_back(std::move(handler));
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef BASE_CORE_SEARCHTOKEN_H_
+#define BASE_CORE_SEARCHTOKEN_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Cancellation of a running search, given to DataSource with the query.
+ *
+ * It's cancelled when nobody waits the result anymore (superseded or timed out).
+ * isCancelled() can be called on any thread, others only on the main loop.
+ */
+class SearchToken {
+public:
+    // milliseconds until the deadline (0 = no deadline)
+    SearchToken(int timeout = 0);
+    virtual ~SearchToken() {}
+
+    void cancel();
+    // cancelled, or the deadline is passed
+    bool isCancelled();
+
+    // milliseconds left until the deadline (-1 = no deadline)
+    int getRemaining();
+
+    // called once when it's cancelled (right now, if it's already)
+    void onCancelled(function<void()> handler);
+
+private:
+    atomic<bool> m_cancelled;
+    long long m_deadline;
+    vector<function<void()>> m_handlers;
+};
+
+typedef shared_ptr<SearchToken> SearchTokenPtr;
+
+#endif /* BASE_SEARCHTOKEN_H_ */
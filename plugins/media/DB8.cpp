@@ -14,6 +14,8 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <glib.h>
+
 #include "DB8.h"
 
 map<string, shared_ptr<DB8>> DB8::s_instances;
@@ -49,14 +51,86 @@ void DB8::onFinalized()
 
 void DB8::onServerStatusChanged(bool isConnected)
 {
+    // items could be changed while it's not connected
+    for (auto& it : m_watches) {
+        it.second.callId = 0;
+        if (!isConnected) {
+            continue;
+        }
+        startWatch(it.first);
+        it.second.callback();
+    }
+}
 
+void DB8::watch(const string& id, const string& kind, changedCB callback)
+{
+    unwatch(id);
+    m_watches[id] = { kind, std::move(callback), 0 };
+    startWatch(id);
+}
+
+void DB8::unwatch(const string& id)
+{
+    auto it = m_watches.find(id);
+    if (it == m_watches.end()) {
+        return;
+    }
+    if (it->second.callId) {
+        cancel(it->second.callId);
+    }
+    m_watches.erase(it);
 }
 
-bool DB8::find(string kind, string key, string value, databaseCB callback)
+void DB8::startWatch(const string& id)
+{
+    auto it = m_watches.find(id);
+    if (it == m_watches.end() || !isConnected()) {
+        return;
+    }
+    if (it->second.callId) {
+        cancel(it->second.callId);
+    }
+
+    static string method = string("luna://") + getName() + string("/watch");
+
+    JValue requestPayload = Object();
+    requestPayload.put("query", Object());
+    requestPayload["query"].put("from", it->second.kind);
+
+    it->second.callId = call(method, requestPayload.stringify(), [this, id] (LSMessage *message) -> bool {
+        Message response(message);
+        JValue responsePayload = JDomParser::fromString(response.getPayload());
+        Logger::logCallResponse("DB8", "watch", response, responsePayload);
+
+        bool fired = false;
+        if (!responsePayload.hasKey("fired") || (responsePayload["fired"].asBool(fired) != CONV_OK) || !fired) {
+            return true;
+        }
+        auto it = m_watches.find(id);
+        if (it == m_watches.end()) {
+            return true;
+        }
+
+        // this call can't be cancelled in its response
+        g_idle_add(onRewatch, new pair<DB8*, string>(this, id));
+        it->second.callback();
+        return true;
+    }, true);
+}
+
+gboolean DB8::onRewatch(gpointer data)
+{
+    auto target = static_cast<pair<DB8*, string>*>(data);
+    target->first->startWatch(target->second);
+    delete target;
+    return G_SOURCE_REMOVE;
+}
+
+LunaClient::LunaReqTaskID DB8::find(string kind, string key, string value, int limit, databaseCB callback)
 {
     if (!isConnected()) {
         Logger::warning("DB8", __FUNCTION__, getName() + " is not connected");
-        return false;
+        return 0;
     }
 
     static string method = string("luna://") + getName() + string("/find");
@@ -72,26 +146,35 @@ bool DB8::find(string kind, string key, string value, databaseCB callback)
     where.put("collate", "primary");
     requestPayload["query"].put("where", Array());
     requestPayload["query"]["where"].append(where);
+    if (limit > 0) {
+        requestPayload["query"].put("limit", limit);
+    }
 
-    call(method, requestPayload.stringify(), [this, &callback] (LSMessage *message) -> bool {
+    return call(method, requestPayload.stringify(), [this, callback] (LSMessage *message) -> bool {
         Message response(message);
         JValue responsePayload = JDomParser::fromString(response.getPayload());
         Logger::logCallResponse("DB8", __FUNCTION__, response, responsePayload);
 
-        if (responsePayload.isNull())
+        // the caller knows the result is not complete
+        JValue empty = Array();
+        if (responsePayload.isNull()) {
+            callback(false, empty);
             return false;
+        }
 
         bool returnValue = false;
-        if (!responsePayload.hasKey("returnValue") || (responsePayload["returnValue"].asBool(returnValue) != CONV_OK) || !returnValue)
+        if (!responsePayload.hasKey("returnValue") || (responsePayload["returnValue"].asBool(returnValue) != CONV_OK) || !returnValue) {
+            callback(false, empty);
             return false;
+        }
 
         JValue results = responsePayload["results"];
-        if (!results.isArray())
+        if (!results.isArray()) {
+            callback(false, empty);
             return false;
+        }
 
-        callback(results);
+        callback(true, results);
         return true;
     });
-
-    return true;
 }
\ No newline at end of file
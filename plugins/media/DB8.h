@@ -32,8 +32,15 @@ class DB8 : public LunaClient {
 public:
     ~DB8() {}
 
-    using databaseCB = function<void(JValue &results)>;
-    bool find(string kind, string key, string value, databaseCB callback);
+    // 'results' is empty if it's failed (error response)
+    using databaseCB = function<void(bool success, JValue &results)>;
+    // limit = 0 means DB8's default, returns the call id to cancel it (0 if failed)
+    LunaReqTaskID find(string kind, string key, string value, int limit, databaseCB callback);
+
+    // called when items of the kind are changed (or the service is connected again), until unwatch()
+    using changedCB = function<void()>;
+    void watch(const string& id, const string& kind, changedCB callback);
+    void unwatch(const string& id);
 
     static shared_ptr<DB8> getDB(const string& service);
 
@@ -46,7 +53,18 @@ protected:
 private:
     DB8(const string& service);
 
+    struct Watch {
+        string kind;
+        changedCB callback;
+        LunaReqTaskID callId;
+    };
+
+    // a watch is fired only once, it's started again for next changes
+    void startWatch(const string& id);
+    static gboolean onRewatch(gpointer data);
+
     int m_callId;
+    map<string, Watch> m_watches;
     map<string, Call> m_calls;
 
     static map<string, shared_ptr<DB8>> s_instances;
@@ -14,14 +14,23 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+
 #include "DB8Source.h"
 
 DB8Source::DB8Source(const string& id, const string& db)
-    : DataSource(id)
+    : DataSourceV3(id)
     , m_db(DB8::getDB(db))
 {
 }
 
+DB8Source::~DB8Source()
+{
+    for (auto& it : m_kindMap) {
+        m_db->unwatch(it.first);
+    }
+}
+
 bool DB8Source::addKind(const string& id, JValue kind)
 {
     if (m_kindMap.find(id) != m_kindMap.end()) {
@@ -35,6 +44,11 @@ bool DB8Source::addKind(const string& id, JValue kind)
     }
 
     m_kindMap.insert({id, kind});
+
+    // found items are changed
+    m_db->watch(id, kind["kind"].asString(), [this] () {
+        notifyChanged();
+    });
     return true;
 }
 
@@ -46,16 +60,47 @@ bool DB8Source::removeKind(const string& id)
     }
 
     m_kindMap.erase(id);
+    m_db->unwatch(id);
     return true;
 }
 
 bool DB8Source::search(const string& searchKey, searchCB cb)
 {
-    shared_ptr<SearchTask> task = make_shared<SearchTask>(getId(), searchKey, cb);
+    return search(make_shared<SearchQuery>(searchKey), std::move(cb));
+}
+
+bool DB8Source::search(SearchQueryPtr query, searchCB cb)
+{
+    return search(std::move(query), make_shared<SearchToken>(), std::move(cb));
+}
+
+bool DB8Source::search(SearchQueryPtr query, SearchTokenPtr token, searchCB cb)
+{
+    return searchChunks(std::move(query), std::move(token), collect(std::move(cb)));
+}
+
+/**
+ * Items of all finds are given when all are done. Finds respond in any order,
+ * items are sorted by the order of targets and '_id' before limits are applied.
+ */
+bool DB8Source::searchChunks(SearchQueryPtr query, SearchTokenPtr token, chunkCB cb)
+{
+    const string& searchKey = query->getKey();
+    shared_ptr<SearchTask> task = make_shared<SearchTask>(getId(), query, cb);
+
+    // each find doesn't need more than the limits
+    int limit = query->getMaxItems();
+    if (limit <= 0 || (query->getLimit() > 0 && query->getLimit() < limit)) {
+        limit = query->getLimit();
+    }
 
     // for all registered kind
+    int order = 0;
     for (auto& it : m_kindMap) {
         string category = it.first;
+        if (!query->isTarget(category)) {
+            continue;
+        }
         JValue kind = it.second;
 
         string kindStr = kind["kind"].asString();
@@ -65,11 +110,21 @@ bool DB8Source::search(const string& searchKey, searchCB cb)
         // for all targets (DB8 'prop')
         for (auto targetObj : targetObjs.items()) {
             string target = targetObj.asString();
-            m_db->find(kindStr, target, searchKey, [this, category, searchKey, target, task, extraWants] (JValue &results) {
-                // get item vector from shared task
-                vector<SearchItemPtr> &items = task->items();
+            auto callId = m_db->find(kindStr, target, searchKey, limit, [this, category, searchKey, target, order, task, token, extraWants] (bool success, JValue &results) {
+                // nobody waits it (or expired), don't make items. the result is not complete
+                if (token->isCancelled()) {
+                    task->setFailed();
+                    return;
+                }
+                if (!success) {
+                    Logger::warning("DB8Source", "search", Logger::format("Failed to find '%s' on %s:%s", searchKey.c_str(), category.c_str(), target.c_str()));
+                    task->setFailed();
+                    return;
+                }
+
                 // convert DB find result to searchitem & push it
                 for (auto result : results.items()) {
+                    string id = result["_id"].asString();
                     string file = result["file_path"].asString();
                     string title = result["title"].asString();
 
@@ -88,30 +143,88 @@ bool DB8Source::search(const string& searchKey, searchCB cb)
                             string want = wantObj.asString();
                             extra.put(want, result[want]);
                         }
-                        items.push_back(make_shared<SearchItem>(category, file, title, display, extra));
+                        task->add(order, id, make_shared<SearchItem>(category, file, title, display, extra));
                     } else {
-                        items.push_back(make_shared<SearchItem>(category, file, title, display));
+                        task->add(order, id, make_shared<SearchItem>(category, file, title, display));
                     }
                 }
                 Logger::info("DB8Source", "search", Logger::format("Find '%s' => %d item(s) on %s:%s", searchKey.c_str(), results.arraySize(), category.c_str(), target.c_str()));
             });
+            if (callId) {
+                task->addCall(callId);
+            } else {
+                // not connected
+                task->setFailed();
+            }
+            order++;
         }
     }
+
+    // stop finds not responded yet (the task ends with items so far)
+    weak_ptr<SearchTask> weakTask = task;
+    token->onCancelled([this, weakTask] () {
+        auto task = weakTask.lock();
+        if (!task) {
+            return;
+        }
+        task->setFailed();
+        int cancelled = 0;
+        for (auto callId : task->getCalls()) {
+            if (m_db->cancel(callId)) {
+                cancelled++;
+            }
+        }
+        Logger::info("DB8Source", "search", Logger::format("Cancelled %d find(s)", cancelled));
+    });
     return true;
 }
 
-DB8Source::SearchTask::SearchTask(const string& id, const string& key, searchCB cb)
+DB8Source::SearchTask::SearchTask(const string& id, SearchQueryPtr query, chunkCB cb)
     : m_id(id)
-    , m_key(key)
+    , m_query(std::move(query))
     , m_callback(std::move(cb))
+    , m_failed(false)
 {
-    Logger::debug("DB8Source", __FUNCTION__, Logger::format("Search task started: %s", key.c_str()));
+    Logger::debug("DB8Source", __FUNCTION__, Logger::format("Search task started: %s", m_query->getKey().c_str()));
 }
 
 DB8Source::SearchTask::~SearchTask()
 {
     if (m_callback) {
-        m_callback(m_id, m_items);
+        m_callback(m_id, take(), vector<string>(), true, m_failed);
     }
     Logger::debug("DB8Source", __FUNCTION__, "Search task ended");
-}
\ No newline at end of file
+}
+
+void DB8Source::SearchTask::add(int order, const string& id, SearchItemPtr item)
+{
+    m_items.push_back({order, id, std::move(item)});
+}
+
+/**
+ * Same items are given for the same query, whichever find responded first
+ */
+vector<SearchItemPtr> DB8Source::SearchTask::take()
+{
+    stable_sort(m_items.begin(), m_items.end(), [] (const Found& a, const Found& b) {
+        return a.order != b.order ? a.order < b.order : a.id < b.id;
+    });
+
+    vector<SearchItemPtr> items;
+    map<string, int> counts;
+    int limit = m_query->getLimit();
+    int maxItems = m_query->getMaxItems();
+    for (auto& found : m_items) {
+        if (limit > 0 && (int)items.size() >= limit) {
+            break;
+        }
+        int& count = counts[found.item->getCategory()];
+        if (maxItems > 0 && count >= maxItems) {
+            continue;
+        }
+        count++;
+        items.push_back(std::move(found.item));
+    }
+    m_items.clear();
+    return items;
+}
@@ -30,28 +30,48 @@
 using namespace std;
 using namespace pbnjson;
 
-class DB8Source : public DataSource {
+class DB8Source : public DataSourceV3 {
 public:
     DB8Source(const string& id, const string& db);
-    ~DB8Source() {}
+    ~DB8Source();
 
     bool search(const string& searchKey, searchCB cb) override;
+    bool search(SearchQueryPtr query, searchCB cb) override;
+    bool search(SearchQueryPtr query, SearchTokenPtr token, searchCB cb) override;
+    bool searchChunks(SearchQueryPtr query, SearchTokenPtr token, chunkCB cb) override;
     bool addKind(const string& id, JValue kind);
     bool removeKind(const string& id);
 
 private:
     class SearchTask {
     public:
-        SearchTask(const string& id, const string& key, searchCB cb);
+        SearchTask(const string& id, SearchQueryPtr query, chunkCB cb);
         ~SearchTask();
 
-        vector<SearchItemPtr>& items() { return m_items; };
+        // kept until all finds are done (order of the target, '_id' of the item)
+        void add(int order, const string& id, SearchItemPtr item);
+        // some of finds are not done, items may be missing
+        void setFailed() { m_failed = true; }
+
+        void addCall(LunaClient::LunaReqTaskID callId) { m_calls.push_back(callId); }
+        const vector<LunaClient::LunaReqTaskID>& getCalls() { return m_calls; }
 
     private:
         string m_id;
-        string m_key;
-        searchCB m_callback;
-        vector<SearchItemPtr> m_items;
+        SearchQueryPtr m_query;
+        chunkCB m_callback;
+        struct Found {
+            int order;
+            string id;
+            SearchItemPtr item;
+        };
+
+        // sorted items within limits of the query
+        vector<SearchItemPtr> take();
+
+        vector<Found> m_items;
+        vector<LunaClient::LunaReqTaskID> m_calls;
+        bool m_failed;
     };
 
     DB8Ptr m_db;
@@ -19,6 +19,7 @@
 #include <glib.h>
 
 #include "base/Database.h"
+#include "base/Indexer.h"
 #include "base/SearchManager.h"
 #include "bus/service/UnifiedSearch.h"
 #include "bus/client/Configd.h"
@@ -44,6 +45,7 @@ void MainDaemon::initialize()
 {
     ConfFile::getInstance()->initialize();
     Database::getInstance()->initialize();
+    Indexer::getInstance()->initialize();
     UnifiedSearch::getInstance()->initialize(m_mainLoop);
 
     SettingService::getInstance()->initialize();
@@ -56,7 +58,8 @@ void MainDaemon::finalize()
     SearchManager::getInstance()->finalize();
     SAM::getInstance()->finalize();
     SettingService::getInstance()->finalize();
-    
+
+    Indexer::getInstance()->finalize();
     Database::getInstance()->finalize();
     ConfFile::getInstance()->finalize();
 }
@@ -14,6 +14,11 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <glib.h>
 #include <pbnjson.hpp>
 
 #include "base/Database.h"
@@ -23,28 +28,215 @@
 #include "util/File.h"
 #include "Logger.h"
 
+// Increase it when the schema is changed and add the way to upgrade into migrationQueries
+static const int DATABASE_VERSION = 4;
+
+// max items committed in a transaction by insertItems
+static const size_t ITEM_CHUNK_SIZE = 500;
+
+// max items given at once by searchChunks
+static const size_t SEARCH_CHUNK_SIZE = 50;
+
+// VM instructions between checks of cancelled searches
+static const int SEARCH_PROGRESS_OPS = 1000;
+
+// milliseconds for searches to wait a commit, when it's not WAL mode
+static const int READ_BUSY_TIMEOUT = 1000;
+
+// searches should be stopped for this before maintenance (microseconds)
+static const gint64 MAINTENANCE_QUIET = 10 * G_USEC_PER_SEC;
+
+// pages merged (or vacuumed) by each statement of maintenance
+static const int MAINTENANCE_PAGES = 64;
+
+// values allowed for pragmas from the conf file (and here)
+static const map<string, set<string>> pragmaValues = {
+    { "auto_vacuum",  { "NONE", "FULL", "INCREMENTAL" } },
+    { "journal_mode", { "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF" } },
+    { "synchronous",  { "OFF", "NORMAL", "FULL", "EXTRA" } },
+    { "temp_store",   { "DEFAULT", "FILE", "MEMORY" } }
+};
+
 static const map<string, string> tableQueries = {
-    { "ITEM", "CREATE VIRTUAL TABLE IF NOT EXISTS Items USING FTS3(category, key, text, display, extra);" },
-    { "CATEGORY", "CREATE TABLE IF NOT EXISTS Category(id TEXT PRIMARY KEY, name TEXT, rank INTEGER, enabled INTEGER);" }
+    { "ITEM", "CREATE VIRTUAL TABLE IF NOT EXISTS Items USING FTS5(text, prefix='2 3 4');" },
+    { "ITEM_KEY", "CREATE TABLE IF NOT EXISTS ItemKeys(id INTEGER PRIMARY KEY, category INTEGER, key TEXT, display INTEGER, extra INTEGER);" },
+    { "ITEM_KEY_INDEX", "CREATE INDEX IF NOT EXISTS ItemKeysIndex ON ItemKeys(category, key);" },
+    { "ITEM_DATA", "CREATE TABLE IF NOT EXISTS ItemData(id INTEGER PRIMARY KEY, hash INTEGER, value TEXT);" },
+    { "ITEM_DATA_INDEX", "CREATE INDEX IF NOT EXISTS ItemDataIndex ON ItemData(hash);" },
+    { "CATEGORY_ID", "CREATE TABLE IF NOT EXISTS CategoryIds(id INTEGER PRIMARY KEY, name TEXT UNIQUE);" },
+    { "CATEGORY", "CREATE TABLE IF NOT EXISTS Category(id TEXT PRIMARY KEY, name TEXT, rank INTEGER, enabled INTEGER);" },
+    { "FINGERPRINT", "CREATE TABLE IF NOT EXISTS Fingerprints(category TEXT PRIMARY KEY, value TEXT);" }
 };
 
 static const map<string, string> statementQueries = {
-    { "ITEM_INSERT",     "INSERT INTO Items values (?, ?, ?, ?, ?);" },
-    { "ITEM_SELECT",     "SELECT * FROM Items WHERE text MATCH ?" },
+    { "ITEM_INSERT",     "INSERT INTO Items(text) values (?);" },
+    { "ITEM_DELETE_KEY", "DELETE FROM Items WHERE rowid IN (SELECT id FROM ItemKeys WHERE category = (SELECT id FROM CategoryIds WHERE name = ?) AND key = ?);" },
+    { "ITEM_DELETE_CATE", "DELETE FROM Items WHERE rowid IN (SELECT id FROM ItemKeys WHERE category = (SELECT id FROM CategoryIds WHERE name = ?));" },
+    { "KEY_INSERT",      "INSERT INTO ItemKeys(id, category, key, display, extra) values (?1, (SELECT id FROM CategoryIds WHERE name = ?2), ?3, ?4, ?5);" },
+    { "KEY_DELETE_KEY",  "DELETE FROM ItemKeys WHERE category = (SELECT id FROM CategoryIds WHERE name = ?) AND key = ?;" },
+    { "KEY_DELETE_CATE", "DELETE FROM ItemKeys WHERE category = (SELECT id FROM CategoryIds WHERE name = ?);" },
+    { "CATE_ID_INSERT",  "INSERT OR IGNORE INTO CategoryIds(name) values (?);" },
+    { "DATA_SELECT",     "SELECT id, value FROM ItemData WHERE hash = ?;" },
+    { "DATA_INSERT",     "INSERT INTO ItemData(hash, value) values (?, ?);" },
+    { "DATA_COLLECT",    "DELETE FROM ItemData WHERE id IN (SELECT id FROM ItemData WHERE id NOT IN (SELECT display FROM ItemKeys WHERE display IS NOT NULL) "
+                         "AND id NOT IN (SELECT extra FROM ItemKeys WHERE extra IS NOT NULL) LIMIT ?);" },
+    { "ITEM_SELECT",     "WITH Matched AS (SELECT Items.rowid AS id, Keys.category AS category, coalesce(Cates.key, 0) AS crank, "
+                         "bm25(Items) AS score FROM Items JOIN ItemKeys AS Keys ON Keys.id = Items.rowid "
+                         "JOIN CategoryIds AS Names ON Names.id = Keys.category LEFT JOIN json_each(?2) AS Cates ON Cates.value = Names.name "
+                         "WHERE Items.text MATCH ?1 AND (?2 IS NULL OR Cates.value IS NOT NULL)), "
+                         "Ranked AS (SELECT id, crank, score, row_number() OVER (PARTITION BY category ORDER BY score, id) AS nth FROM Matched) "
+                         "SELECT Names.name, Keys.key, Items.text, Display.value, Extra.value, crank, score, Ranked.id "
+                         "FROM Ranked JOIN Items ON Items.rowid = Ranked.id JOIN ItemKeys AS Keys ON Keys.id = Ranked.id "
+                         "JOIN CategoryIds AS Names ON Names.id = Keys.category "
+                         "LEFT JOIN ItemData AS Display ON Display.id = Keys.display LEFT JOIN ItemData AS Extra ON Extra.id = Keys.extra "
+                         "WHERE (?3 <= 0 OR nth <= ?3) AND (?5 IS NULL OR (crank, score, Ranked.id) > (?5, ?6, ?7)) "
+                         "ORDER BY crank, score, Ranked.id LIMIT ?4;" },
     { "CATE_INSERT",     "INSERT INTO Category values (?, ?, ?, 1);" },
     { "CATE_UPDATE",     "UPDATE Category set rank = ?, enabled = ?, name = ? where id = ?;" },
     { "CATE_DELETE",     "DELETE FROM Category WHERE id = ?;" },
-    { "CATE_SELECT",     "SELECT * FROM Category WHERE id = ?;" },
     { "CATE_RANK",       "SELECT * FROM Category ORDER BY rank ASC;" },
-    { "CATE_MAXRANK",    "SELECT max(rank) FROM Category WHERE enabled = 1;" },
-    { "CATE_CHANGERANK", "UPDATE Category SET rank = rank + ? WHERE enabled = 1 AND rank >= ? AND rank <= ?;" }
+    { "CATE_CHANGERANK", "UPDATE Category SET rank = rank + ? WHERE enabled = 1 AND rank >= ? AND rank <= ?;" },
+    { "FP_SELECT",       "SELECT category, value FROM Fingerprints;" },
+    { "FP_UPDATE",       "INSERT OR REPLACE INTO Fingerprints values (?, ?);" },
+    { "FP_DELETE",       "DELETE FROM Fingerprints WHERE category = ?;" },
+    { "TX_BEGIN",        "BEGIN;" },
+    { "TX_COMMIT",       "COMMIT;" },
+    { "TX_ROLLBACK",     "ROLLBACK;" }
 };
 
-static const map<string, string> normalQueries = {
-    { "ITEM_DELETE", "DELETE FROM Items WHERE category = '" }
+// key = version to upgrade to, value = queries to upgrade from the previous version
+static const map<int, string> migrationQueries = {
+    // v1: FTS3 => FTS5 with prefix indexes (for bm25 ranking and fast short prefixes)
+    { 1, "CREATE VIRTUAL TABLE ItemsMigrated USING FTS5(category, key, text, display, extra, prefix='2 3 4');"
+         "INSERT INTO ItemsMigrated(category, key, text, display, extra) SELECT category, key, text, display, extra FROM Items;"
+         "DROP TABLE Items;"
+         "ALTER TABLE ItemsMigrated RENAME TO Items;" },
+    // v2: (category, key) => rowid side index, FTS can't look up by columns
+    { 2, "CREATE TABLE ItemKeys(id INTEGER PRIMARY KEY, category TEXT, key TEXT);"
+         "INSERT INTO ItemKeys(id, category, key) SELECT rowid, category, key FROM Items;" },
+    // v3: integer category ids, display and extra stored once in ItemData (not tokenized)
+    { 3, "CREATE TABLE CategoryIds(id INTEGER PRIMARY KEY, name TEXT UNIQUE);"
+         "INSERT INTO CategoryIds(name) SELECT DISTINCT category FROM Items;"
+         "CREATE TABLE ItemData(id INTEGER PRIMARY KEY, hash INTEGER, value TEXT);"
+         "INSERT INTO ItemData(hash, value) SELECT fnv1a(value), value FROM (SELECT display AS value FROM Items UNION SELECT extra FROM Items) WHERE value IS NOT NULL;"
+         "CREATE INDEX ItemDataIndex ON ItemData(hash);"
+         "CREATE TABLE ItemKeysMigrated(id INTEGER PRIMARY KEY, category INTEGER, key TEXT, display INTEGER, extra INTEGER);"
+         "INSERT INTO ItemKeysMigrated(id, category, key, display, extra) SELECT Items.rowid, Names.id, Items.key, Display.id, Extra.id FROM Items "
+         "JOIN CategoryIds AS Names ON Names.name = Items.category "
+         "LEFT JOIN ItemData AS Display ON Display.hash = fnv1a(Items.display) AND Display.value = Items.display "
+         "LEFT JOIN ItemData AS Extra ON Extra.hash = fnv1a(Items.extra) AND Extra.value = Items.extra;"
+         "DROP TABLE ItemKeys;"
+         "ALTER TABLE ItemKeysMigrated RENAME TO ItemKeys;"
+         "CREATE VIRTUAL TABLE ItemsMigrated USING FTS5(key, text, prefix='2 3 4');"
+         "INSERT INTO ItemsMigrated(rowid, key, text) SELECT rowid, key, text FROM Items;"
+         "DROP TABLE Items;"
+         "ALTER TABLE ItemsMigrated RENAME TO Items;" },
+    // v4: only text is tokenized, key is in ItemKeys
+    { 4, "CREATE VIRTUAL TABLE ItemsMigrated USING FTS5(text, prefix='2 3 4');"
+         "INSERT INTO ItemsMigrated(rowid, text) SELECT rowid, text FROM Items;"
+         "DROP TABLE Items;"
+         "ALTER TABLE ItemsMigrated RENAME TO Items;" }
 };
 
-Database::Database() : DataSource("sqlite3"), m_database(nullptr)
+/**
+ * 64-bit FNV-1a, to find same display/extra already stored
+ */
+static sqlite3_int64 fnv1a(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<sqlite3_int64>(hash);
+}
+
+// same as SQL function, for migration
+static void fnv1aFunction(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    if (argc != 1 || sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const char* text = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+    sqlite3_result_int64(context, fnv1a(text, sqlite3_value_bytes(argv[0])));
+}
+
+/**
+ * Convert search key to FTS5 query.
+ *
+ * Each word is quoted to escape FTS5 syntax, and the last one is matched as a prefix.
+ * e.g. 'hello wo' => '"hello" "wo"*'
+ */
+static string toMatchQuery(const string& searchKey)
+{
+    string query;
+    istringstream words(searchKey);
+    string word;
+    while (words >> word) {
+        if (!query.empty()) {
+            query += " ";
+        }
+        query += "\"";
+        for (char c : word) {
+            if (c == '"') {
+                query += "\"";
+            }
+            query += c;
+        }
+        query += "\"";
+    }
+    if (!query.empty()) {
+        query += "*";
+    }
+    return query;
+}
+
+/**
+ * Split to tokens like FTS5 'unicode61' tokenizer, for ASCII text only.
+ *
+ * Returns false if the text has any non-ASCII character. The tokenizer folds
+ * diacritics and separates by Unicode categories, it can't be matched exactly here.
+ */
+static bool toAsciiTokens(const string& text, vector<string>& tokens)
+{
+    string token;
+    for (size_t i = 0; i <= text.size(); i++) {
+        unsigned char c = (i < text.size()) ? text[i] : ' ';
+        if (c >= 0x80) {
+            return false;
+        }
+        if (!isalnum(c)) {
+            if (!token.empty()) {
+                tokens.push_back(std::move(token));
+                token.clear();
+            }
+            continue;
+        }
+        token += tolower(c);
+    }
+    return true;
+}
+
+Database::Database()
+    : DataSourceV3("sqlite3")
+    , m_database(nullptr)
+    , m_writer("writer")
+    , m_readDatabase(nullptr)
+    , m_searchStatement(nullptr)
+    , m_reader("reader")
+    , m_categoryGeneration(0)
+    , m_searching(0)
+    , m_lastSearch(0)
+    , m_maintenanceTimer(0)
+    , m_maintaining(false)
+    , m_needsMaintenance(true)
+    , m_maintenanceRuns(0)
+    , m_mergeSteps(0)
+    , m_optimizeSteps(0)
+    , m_vacuumedPages(0)
+    , m_collectedData(0)
+    , m_maintenanceMs(0)
 {
 }
 
@@ -65,6 +257,25 @@ bool Database::onInitialization()
         return false;
     }
 
+    // free pages are given back by maintenance steps, it should be set before WAL writes the first page.
+    // old files (or not applied for some reason) need VACUUM once for it (see below)
+    setPragma(m_database, "auto_vacuum", "INCREMENTAL");
+    bool needsVacuum = getPragma(m_database, "auto_vacuum") != "2";
+
+    // tuning from the conf file (WAL: searches on another connection are not blocked by writes)
+    auto conf = ConfFile::getInstance();
+    setPragma(m_database, "journal_mode", conf->getJournalMode());
+    setPragma(m_database, "synchronous", conf->getSynchronous());
+    setPragma(m_database, "cache_size", to_string(conf->getCacheSize()));
+    setPragma(m_database, "mmap_size", to_string(conf->getMmapSize()));
+    setPragma(m_database, "temp_store", conf->getTempStore());
+
+    // upgrade old database before touching tables
+    sqlite3_create_function(m_database, "fnv1a", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, fnv1aFunction, nullptr, nullptr);
+    if (!migrate()) {
+        return false;
+    }
+
     // if it's not exist before, need table
     char *err_msg = nullptr;
     for (auto& it : tableQueries) {
@@ -77,23 +288,102 @@ bool Database::onInitialization()
         }
     }
 
+    if (!execute(Logger::format("PRAGMA user_version = %d;", DATABASE_VERSION))) {
+        return false;
+    }
+
+    // once, before any statement is prepared. it takes long for big files, so it's not done by maintenance steps.
+    // it's not tried again even if it failed (e.g. no space), incremental steps just do nothing
+    if (needsVacuum && !execute("VACUUM;")) {
+        Logger::warning(getClassName(), __FUNCTION__, "Failed to VACUUM, free pages are not given back");
+    }
+
     // create statements
     for (auto& it : statementQueries) {
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare(m_database, it.second.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        if (sqlite3_prepare_v2(m_database, it.second.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
             Logger::error(getClassName(), __FUNCTION__, "Failed to create '%s' statement", it.first.c_str());
             return false;
         }
         m_statements.insert({it.first, stmt});
     }
 
+    // fingerprints are small (one per indexed app), keep them on memory
+    auto stmt = m_statements["FP_SELECT"];
+    sqlite3_reset(stmt);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        m_fingerprints[category] = value ? value : "";
+    }
+
+    // categories are read on every search response, keep them on memory
+    stmt = m_statements["CATE_RANK"];
+    sqlite3_reset(stmt);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        auto category = make_shared<Category>(id, name ? name : "");
+        category->setRank(sqlite3_column_int(stmt, 2));
+        category->setEnabled(sqlite3_column_int(stmt, 3));
+        m_categories.push_back(std::move(category));
+    }
+
+    // read only connection for searches
+    if (sqlite3_open_v2(file.c_str(), &m_readDatabase, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to open for read: %s", sqlite3_errmsg(m_readDatabase)));
+        sqlite3_close(m_readDatabase);
+        m_readDatabase = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(m_readDatabase, READ_BUSY_TIMEOUT);
+    setPragma(m_readDatabase, "cache_size", to_string(conf->getCacheSize()));
+    setPragma(m_readDatabase, "mmap_size", to_string(conf->getMmapSize()));
+    setPragma(m_readDatabase, "temp_store", conf->getTempStore());
+    if (sqlite3_prepare_v2(m_readDatabase, statementQueries.at("ITEM_SELECT").c_str(), -1, &m_searchStatement, NULL) != SQLITE_OK) {
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to create search statement: %s", sqlite3_errmsg(m_readDatabase)));
+        return false;
+    }
+
+    // applied values (e.g. journal mode can't be changed on some file systems)
+    m_pragmas = Object();
+    m_pragmas.put("journalMode", getPragma(m_database, "journal_mode"));
+    m_pragmas.put("synchronous", atoi(getPragma(m_database, "synchronous").c_str()));
+    m_pragmas.put("cacheSize", atoi(getPragma(m_database, "cache_size").c_str()));
+    m_pragmas.put("mmapSize", atoll(getPragma(m_database, "mmap_size").c_str()));
+    m_pragmas.put("tempStore", atoi(getPragma(m_database, "temp_store").c_str()));
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Pragmas: %s", m_pragmas.stringify().c_str()));
+
+    // m_database is used only by the writer from here
+    m_writer.start();
+    m_reader.start();
+
+    if (conf->getMaintenanceInterval() > 0) {
+        m_maintenanceTimer = g_timeout_add_seconds(conf->getMaintenanceInterval(), onMaintenance, this);
+    }
+
     Logger::info(getClassName(), __FUNCTION__, "Openning database successed");
     return true;
 }
 
 bool Database::onFinalization()
 {
+    if (m_maintenanceTimer) {
+        g_source_remove(m_maintenanceTimer);
+        m_maintenanceTimer = 0;
+    }
+
+    // pending searches are not needed, but each gives its last part (as failed) quickly.
+    // pending writes are needed
+    for (auto& token : m_searchTokens) {
+        token->cancel();
+    }
+    m_reader.stop(true);
+    m_writer.stop(true);
+
     // close DB
+    sqlite3_finalize(m_searchStatement);
+    sqlite3_close(m_readDatabase);
     for (auto& it : m_statements) {
         sqlite3_finalize(it.second);
     }
@@ -101,6 +391,122 @@ bool Database::onFinalization()
     return true;
 }
 
+bool Database::execute(const string& query)
+{
+    char *err_msg = nullptr;
+    if (sqlite3_exec(m_database, query.c_str(), 0, 0, &err_msg) != SQLITE_OK) {
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to execute: %s", err_msg));
+        if (err_msg) {
+            sqlite3_free(err_msg);
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Set a pragma on the connection, string values are checked not to inject others
+ */
+bool Database::setPragma(sqlite3* db, const string& name, const string& value)
+{
+    string upper;
+    for (char c : value) {
+        upper += toupper(static_cast<unsigned char>(c));
+    }
+    auto allowed = pragmaValues.find(name);
+    if (allowed != pragmaValues.end() && allowed->second.find(upper) == allowed->second.end()) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("Invalid value, ignored: %s = %s", name.c_str(), value.c_str()));
+        return false;
+    }
+    if (allowed == pragmaValues.end() && (value.empty() || value.find_first_not_of("-0123456789") != string::npos)) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("Invalid number, ignored: %s = %s", name.c_str(), value.c_str()));
+        return false;
+    }
+
+    char *err_msg = nullptr;
+    string query = "PRAGMA " + name + " = " + upper + ";";
+    if (sqlite3_exec(db, query.c_str(), 0, 0, &err_msg) != SQLITE_OK) {
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to set %s: %s", name.c_str(), err_msg));
+        if (err_msg) {
+            sqlite3_free(err_msg);
+        }
+        return false;
+    }
+    return true;
+}
+
+string Database::getPragma(sqlite3* db, const string& name)
+{
+    string value;
+    sqlite3_stmt* stmt;
+    string query = "PRAGMA " + name + ";";
+    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL) != SQLITE_OK) {
+        return value;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+        value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+int Database::getVersion()
+{
+    int version = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_database, "PRAGMA user_version;", -1, &stmt, NULL) != SQLITE_OK) {
+        return version;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+bool Database::hasTable(const string& name)
+{
+    bool exist = false;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_database, "SELECT 1 FROM sqlite_master WHERE name = ?;", -1, &stmt, NULL) != SQLITE_OK) {
+        return exist;
+    }
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    exist = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return exist;
+}
+
+bool Database::migrate()
+{
+    int version = getVersion();
+    if (version >= DATABASE_VERSION) {
+        return true;
+    }
+
+    // new database file, tables will be created with the latest schema
+    if (!hasTable("Items")) {
+        return true;
+    }
+
+    for (auto& it : migrationQueries) {
+        if (it.first <= version) {
+            continue;
+        }
+
+        // each step is atomic, so an interrupted migration restarts from the last completed version
+        string query = "BEGIN;" + it.second + Logger::format("PRAGMA user_version = %d;", it.first) + "COMMIT;";
+        if (!execute(query)) {
+            execute("ROLLBACK;");
+            Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to migrate database: v%d => v%d", version, it.first));
+            return false;
+        }
+        Logger::info(getClassName(), __FUNCTION__, Logger::format("Migrated database: v%d => v%d", version, it.first));
+        version = it.first;
+    }
+    return true;
+}
+
 bool Database::adjustOrCreateCategory(CategoryPtr cate)
 {
     if (!cate) {
@@ -108,50 +514,52 @@ bool Database::adjustOrCreateCategory(CategoryPtr cate)
         return false;
     }
 
-    const char* id = cate->getCategoryId().c_str();
-    const char* name = cate->getCategoryName().c_str();
+    const string& id = cate->getCategoryId();
+    const string& name = cate->getCategoryName();
 
     // check it's already exist
-    auto stmt = m_statements["CATE_SELECT"];
-    sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        // already exist get columns
-        name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        int rank = sqlite3_column_int(stmt, 2);
-        int enabled = sqlite3_column_int(stmt, 3);
+    auto stored = findCategory(id);
+    if (stored) {
         // adjust category info from DB
-        cate->setCategoryName(name);
-        cate->setRank(rank);
-        cate->setEnabled(enabled);
-        Logger::info(getClassName(), __FUNCTION__, Logger::format("Adjustted: Category (%s, '%s', %d, %s)", id, name, rank, (enabled ? "Y" : "N")));
-    } else {
-        // not exist, get add max rank first
-        int rank = RANK_MAX;
-        stmt = m_statements["CATE_MAXRANK"];
-        sqlite3_reset(stmt);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            // already exist get columns
-            rank = sqlite3_column_int(stmt, 0) + 1;
+        cate->setCategoryName(stored->getCategoryName());
+        cate->setRank(stored->getRank());
+        cate->setEnabled(stored->isEnabled());
+        Logger::info(getClassName(), __FUNCTION__, Logger::format("Adjustted: Category (%s, '%s', %d, %s)",
+            id.c_str(), stored->getCategoryName().c_str(), stored->getRank(), (stored->isEnabled() ? "Y" : "N")));
+        return true;
+    }
+
+    // not exist, get add max rank first
+    int rank = 1;
+    for (auto& category : m_categories) {
+        if (category->isEnabled()) {
+            rank = max(rank, category->getRank() + 1);
         }
+    }
+    cate->setRank(rank);
 
-        // add category
-        stmt = m_statements["CATE_INSERT"];
+    stored = make_shared<Category>(id, name);
+    stored->setRank(rank);
+    m_categories.push_back(std::move(stored));
+    sortCategories();
+    m_categoryGeneration++;
+
+    // add category
+    write([this, id, name, rank] () {
+        auto stmt = m_statements["CATE_INSERT"];
         sqlite3_reset(stmt);
-        sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 3, rank);
-        cate->setRank(rank);
-
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             const char *err_msg = sqlite3_errmsg(m_database);
-            Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert category: %s - (%s, %s)", err_msg, id, name));
+            Logger::error(getClassName(), "adjustOrCreateCategory", Logger::format("Failed to insert category: %s - (%s, %s)", err_msg, id.c_str(), name.c_str()));
             return false;
         }
+        return true;
+    });
 
-        Logger::info(getClassName(), __FUNCTION__, Logger::format("Inserted: Category (%s, '%s')", id, name));
-    }
-
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Inserted: Category (%s, '%s')", id.c_str(), name.c_str()));
     return true;
 }
 
@@ -162,17 +570,29 @@ bool Database::removeCategory(const string& cateId)
         return false;
     }
 
-    auto stmt = m_statements["CATE_REMOVE"];
-    sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, cateId.c_str(), -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        const char *err_msg = sqlite3_errmsg(m_database);
-        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to remove category: %s - %s", err_msg, cateId.c_str()));
-        return false;
+    auto it = find_if(m_categories.begin(), m_categories.end(), [&cateId] (const CategoryPtr& category) {
+        return category->getCategoryId() == cateId;
+    });
+    if (it != m_categories.end()) {
+        m_categories.erase(it);
+        m_categoryGeneration++;
     }
 
+    write([this, cateId] () {
+        auto stmt = m_statements["CATE_DELETE"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, cateId.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), "removeCategory", Logger::format("Failed to remove category: %s - %s", err_msg, cateId.c_str()));
+            return false;
+        }
+        return true;
+    });
+
     // remove items also
     removeItem(cateId);
+    removeFingerprint(cateId);
 
     Logger::info(getClassName(), __FUNCTION__, Logger::format("Removed: Category %s", cateId.c_str()));
     return true;
@@ -191,23 +611,21 @@ bool Database::updateCategory(CategoryPtr cate)
     int oldRank = -1;
     bool oldEnabled = false;
 
-    // before update, get current DB data to order rank correctly
+    // before update, get current data to order rank correctly
     int countEnabledCate = 0;
-    auto stmt = m_statements["CATE_RANK"];
-    sqlite3_reset(stmt);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *cateId = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        int rank = sqlite3_column_int(stmt, 2);
-        bool enabled = sqlite3_column_int(stmt, 3) > 0;
+    CategoryPtr stored;
+    for (auto& category : m_categories) {
+        bool enabled = category->isEnabled();
         if (enabled) {
             countEnabledCate++;
         }
-        if (id == cateId) {
-            oldRank = rank;
+        if (id == category->getCategoryId()) {
+            stored = category;
+            oldRank = category->getRank();
             oldEnabled = enabled;
             // if no name entered, use previous one
             if (name.empty()) {
-                name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                name = category->getCategoryName();
             }
             // if disable => enable case, it should be cared enabled one for count
             if (!oldEnabled && cate->isEnabled()) {
@@ -243,140 +661,842 @@ bool Database::updateCategory(CategoryPtr cate)
         }
     }
 
+    stored->setCategoryName(name);
+    stored->setRank(rank);
+    stored->setEnabled(enabled);
+    sortCategories();
+    m_categoryGeneration++;
+
     // update itself
-    stmt = m_statements["CATE_UPDATE"];
-    sqlite3_reset(stmt);
-    sqlite3_bind_int(stmt, 1, rank);
-    sqlite3_bind_int(stmt, 2, enabled);
-    sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, id.c_str(), -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        const char *err_msg = sqlite3_errmsg(m_database);
-        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to update category: %s - (%s, %s)", err_msg, id.c_str(), name.c_str()));
-        return false;
-    }
+    write([this, id, name, rank, enabled] () {
+        auto stmt = m_statements["CATE_UPDATE"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, rank);
+        sqlite3_bind_int(stmt, 2, enabled);
+        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, id.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), "updateCategory", Logger::format("Failed to update category: %s - (%s, %s)", err_msg, id.c_str(), name.c_str()));
+            return false;
+        }
+        return true;
+    });
 
     Logger::info(getClassName(), __FUNCTION__, Logger::format("Updated: Category (%s, '%s', %d, %s)", id.c_str(), name.c_str(), rank, (enabled ? "Y" : "N")));
 
     return true;
 }
 
-vector<CategoryPtr> Database::getCategories() {
-    vector<CategoryPtr> categories;
+CategoryPtr Database::findCategory(const string& cateId)
+{
+    for (auto& category : m_categories) {
+        if (category->getCategoryId() == cateId) {
+            return category;
+        }
+    }
+    return nullptr;
+}
 
-    auto stmt = m_statements["CATE_RANK"];
-    sqlite3_reset(stmt);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        // already exist get columns
-        const char* id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        int rank = sqlite3_column_int(stmt, 2);
-        int enabled = sqlite3_column_int(stmt, 3);
-        auto category = make_shared<Category>(id, name);
-        category->setRank(rank);
-        category->setEnabled(enabled);
-        categories.push_back(category);
+void Database::sortCategories()
+{
+    // same order with CATE_RANK
+    stable_sort(m_categories.begin(), m_categories.end(), [] (const CategoryPtr& a, const CategoryPtr& b) {
+        return a->getRank() < b->getRank();
+    });
+}
+
+string Database::getFingerprint(const string& category)
+{
+    auto it = m_fingerprints.find(category);
+    if (it == m_fingerprints.end()) {
+        return "";
+    }
+    return it->second;
+}
+
+bool Database::setFingerprint(const string& category, const string& value)
+{
+    m_fingerprints[category] = value;
+    write([this, category, value] () {
+        auto stmt = m_statements["FP_UPDATE"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, category.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), "setFingerprint", Logger::format("Failed to update fingerprint: %s - %s", err_msg, category.c_str()));
+            return false;
+        }
+        return true;
+    });
+    return true;
+}
+
+bool Database::removeFingerprint(const string& category)
+{
+    if (m_fingerprints.find(category) == m_fingerprints.end()) {
+        return true;
     }
 
-    return categories;
+    m_fingerprints.erase(category);
+    write([this, category] () {
+        auto stmt = m_statements["FP_DELETE"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, category.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), "removeFingerprint", Logger::format("Failed to remove fingerprint: %s - %s", err_msg, category.c_str()));
+            return false;
+        }
+        return true;
+    });
+    return true;
 }
 
 bool Database::updateRanks(int value, int start, int end)
 {
-    auto stmt = m_statements["CATE_CHANGERANK"];
-    sqlite3_reset(stmt);
-    sqlite3_bind_int(stmt, 1, value);
-    sqlite3_bind_int(stmt, 2, start);
-    sqlite3_bind_int(stmt, 3, end);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        const char *err_msg = sqlite3_errmsg(m_database);
-        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to update ranks: %s - (%s, %d-%d)", err_msg, start, end));
-        return false;
+    for (auto& category : m_categories) {
+        int rank = category->getRank();
+        if (category->isEnabled() && rank >= start && rank <= end) {
+            category->setRank(rank + value);
+        }
     }
+
+    write([this, value, start, end] () {
+        auto stmt = m_statements["CATE_CHANGERANK"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, value);
+        sqlite3_bind_int(stmt, 2, start);
+        sqlite3_bind_int(stmt, 3, end);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), "updateRanks", Logger::format("Failed to update ranks: %s - (%d-%d)", err_msg, start, end));
+            return false;
+        }
+        return true;
+    });
     Logger::info(getClassName(), __FUNCTION__, Logger::format("Updated : ranks (%d-%d) %d", start, end, value));
     return true;
 }
 
-bool Database::insertItem(const SearchItemPtr& item)
+bool Database::insertItem(const SearchItemPtr& item, doneCB done)
+{
+    if (!item) {
+        Logger::warning(getClassName(), __FUNCTION__, "Null SearchItem came");
+        return false;
+    }
+    return storeItems({ item }, false, std::move(done));
+}
+
+bool Database::upsertItem(const SearchItemPtr& item, doneCB done)
 {
     if (!item) {
         Logger::warning(getClassName(), __FUNCTION__, "Null SearchItem came");
         return false;
     }
+    return storeItems({ item }, true, std::move(done));
+}
+
+bool Database::insertItems(const vector<SearchItemPtr>& items, doneCB done)
+{
+    return storeItems(items, false, std::move(done));
+}
+
+bool Database::upsertItems(const vector<SearchItemPtr>& items, doneCB done)
+{
+    return storeItems(items, true, std::move(done));
+}
 
-    // to use SQLITE_STATIC (don't copy)
-    string display = item->getDisplay().stringify();
-    string extra = item->getExtra().stringify();
+/**
+ * Replace all items of the category at once.
+ * It's done in one transaction, searches see the old items until it's committed.
+ */
+bool Database::replaceItems(const string& category, const vector<SearchItemPtr>& items, doneCB done)
+{
+    if (category.empty()) {
+        Logger::warning(getClassName(), __FUNCTION__, "Category is empty");
+        return false;
+    }
 
-    auto stmt = m_statements["ITEM_INSERT"];
+    vector<ItemRow> rows = toRows(items);
+    size_t total = items.size();
+    writeItems([this, category, rows, total] () {
+        if (!beginTransaction()) {
+            return false;
+        }
+        if (!deleteItems(category, "")) {
+            rollbackTransaction();
+            return false;
+        }
+        int count = 0;
+        for (auto& row : rows) {
+            if (row.category != category) {
+                Logger::warning(getClassName(), "replaceItems", Logger::format("Not in %s: %s", category.c_str(), row.key.c_str()));
+                continue;
+            }
+            if (bindItem(row)) {
+                count++;
+            }
+        }
+        if (!commitTransaction()) {
+            rollbackTransaction();
+            Logger::error(getClassName(), "replaceItems", Logger::format("Failed to commit: %s", category.c_str()));
+            return false;
+        }
+        Logger::info(getClassName(), "replaceItems", Logger::format("Replaced: %s, %d of %zu item(s)", category.c_str(), count, total));
+        return count == static_cast<int>(total);
+    }, std::move(done));
+    return true;
+}
+
+vector<Database::ItemRow> Database::toRows(const vector<SearchItemPtr>& items)
+{
+    vector<ItemRow> rows;
+    rows.reserve(items.size());
+    for (auto& item : items) {
+        if (!item) {
+            Logger::warning(getClassName(), __FUNCTION__, "Null SearchItem came");
+            continue;
+        }
+        rows.push_back({ item->getCategory(), item->getKey(), item->getValue(), item->getDisplay().stringify(), item->getExtra().stringify() });
+    }
+    return rows;
+}
+
+bool Database::storeItems(const vector<SearchItemPtr>& items, bool replace, doneCB done)
+{
+    vector<ItemRow> rows = toRows(items);
+    size_t total = items.size();
+    writeItems([this, rows, replace, total] () {
+        return storeRows(rows, replace, total);
+    }, std::move(done));
+    return true;
+}
+
+bool Database::storeRows(const vector<ItemRow>& rows, bool replace, size_t total)
+{
+    int count = 0;
+
+    // commit by chunk, not to hold the write lock too long for big inputs
+    for (size_t start = 0; start < rows.size(); start += ITEM_CHUNK_SIZE) {
+        size_t end = min(start + ITEM_CHUNK_SIZE, rows.size());
+        if (!beginTransaction()) {
+            return false;
+        }
+        for (size_t i = start; i < end; i++) {
+            // replace: remove old one first
+            if (replace && !deleteItems(rows[i].category, rows[i].key)) {
+                continue;
+            }
+            if (bindItem(rows[i])) {
+                count++;
+            }
+        }
+        if (!commitTransaction()) {
+            rollbackTransaction();
+            Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to commit: %zu-%zu", start, end));
+            return false;
+        }
+    }
+
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("%s: %d of %zu item(s)", (replace ? "Upserted" : "Inserted"), count, total));
+    return count == static_cast<int>(total);
+}
+
+bool Database::bindItem(const ItemRow& row)
+{
+    // category and payloads are stored once, items refer them by id
+    sqlite3_int64 display = storeData(row.display);
+    sqlite3_int64 extra = storeData(row.extra);
+    if (!display || !extra) {
+        return false;
+    }
+    auto stmt = m_statements["CATE_ID_INSERT"];
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, row.category.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        const char *err_msg = sqlite3_errmsg(m_database);
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert category id: %s - %s", err_msg, row.category.c_str()));
+        return false;
+    }
+
+    stmt = m_statements["ITEM_INSERT"];
     sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, item->getCategory().c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, item->getKey().c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, item->getValue().c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, display.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, extra.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 1, row.text.c_str(), -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
         const char *err_msg = sqlite3_errmsg(m_database);
-        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert: %s - (%s, %s)", err_msg, item->getCategory(), item->getKey()));
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert: %s - (%s, %s)", err_msg, row.category.c_str(), row.key.c_str()));
         return false;
     }
 
-    Logger::debug(getClassName(), __FUNCTION__, Logger::format("Inserted: %s, %s <= %s", item->getCategory().c_str(), item->getKey().c_str(), item->getValue().c_str()));
+    // keep side index with same rowid
+    stmt = m_statements["KEY_INSERT"];
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, sqlite3_last_insert_rowid(m_database));
+    sqlite3_bind_text(stmt, 2, row.category.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, row.key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, display);
+    sqlite3_bind_int64(stmt, 5, extra);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        const char *err_msg = sqlite3_errmsg(m_database);
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert key: %s - (%s, %s)", err_msg, row.category.c_str(), row.key.c_str()));
+        return false;
+    }
+
+    Logger::debug(getClassName(), __FUNCTION__, Logger::format("Inserted: %s, %s <= %s", row.category.c_str(), row.key.c_str(), row.text.c_str()));
     return true;
 }
 
-bool Database::removeItem(const string& category, const string& key)
+/**
+ * Id of the stored value, it's added if not found. 0 if failed.
+ * Items of an app share most of display (e.g. icon), it's stored only once.
+ */
+sqlite3_int64 Database::storeData(const string& value)
+{
+    sqlite3_int64 hash = fnv1a(value.c_str(), value.size());
+    auto stmt = m_statements["DATA_SELECT"];
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, hash);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        // hash can collide, compare the value too
+        const char* stored = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        if (stored && value == stored) {
+            sqlite3_int64 id = sqlite3_column_int64(stmt, 0);
+            sqlite3_reset(stmt);
+            return id;
+        }
+    }
+
+    stmt = m_statements["DATA_INSERT"];
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, hash);
+    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        const char *err_msg = sqlite3_errmsg(m_database);
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to insert data: %s", err_msg));
+        return 0;
+    }
+    return sqlite3_last_insert_rowid(m_database);
+}
+
+bool Database::removeItem(const string& category, const string& key, doneCB done)
 {
     if (category.empty()) {
         Logger::warning(getClassName(), __FUNCTION__, "Category is empty");
     }
 
-    char *err_msg = nullptr;
-    string query = normalQueries.at("ITEM_DELETE");
-    query += category;
+    writeItems([this, category, key] () {
+        if (!beginTransaction()) {
+            return false;
+        }
+        if (!deleteItems(category, key) || !commitTransaction()) {
+            rollbackTransaction();
+            return false;
+        }
+        Logger::debug(getClassName(), "removeItem", Logger::format("Removed: %s, %s", category.c_str(), key.c_str()));
+        return true;
+    }, std::move(done));
+    return true;
+}
+
+bool Database::removeItems(const string& category, const vector<string>& keys, doneCB done)
+{
+    if (category.empty()) {
+        Logger::warning(getClassName(), __FUNCTION__, "Category is empty");
+        return false;
+    }
+
+    writeItems([this, category, keys] () {
+        if (!beginTransaction()) {
+            return false;
+        }
+        for (auto& key : keys) {
+            // empty key means whole category, that's not intended here
+            if (key.empty()) {
+                continue;
+            }
+            if (!deleteItems(category, key)) {
+                rollbackTransaction();
+                return false;
+            }
+        }
+        if (!commitTransaction()) {
+            rollbackTransaction();
+            return false;
+        }
+        Logger::info(getClassName(), "removeItems", Logger::format("Removed: %s, %zu item(s)", category.c_str(), keys.size()));
+        return true;
+    }, std::move(done));
+    return true;
+}
+
+bool Database::deleteItems(const string& category, const string& key)
+{
+    // find rowids from side index, and remove both
+    const char* names[2] = { "ITEM_DELETE_CATE", "KEY_DELETE_CATE" };
     if (!key.empty()) {
-        query += "' AND key = '" + key;
+        names[0] = "ITEM_DELETE_KEY";
+        names[1] = "KEY_DELETE_KEY";
     }
-    query += "';";
 
-    if (sqlite3_exec(m_database, query.c_str(), 0, 0, &err_msg) != SQLITE_OK) {
-        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to delete: %s", err_msg));
-        if (err_msg) {
-            sqlite3_free(err_msg);
+    for (auto name : names) {
+        auto stmt = m_statements[name];
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, category.c_str(), -1, SQLITE_STATIC);
+        if (!key.empty()) {
+            sqlite3_bind_text(stmt, 2, key.c_str(), -1, SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            const char *err_msg = sqlite3_errmsg(m_database);
+            Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to delete: %s - (%s, %s)", err_msg, category.c_str(), key.c_str()));
+            return false;
         }
+    }
+    return true;
+}
+
+bool Database::beginTransaction()
+{
+    return step("TX_BEGIN");
+}
+
+bool Database::commitTransaction()
+{
+    return step("TX_COMMIT");
+}
+
+bool Database::rollbackTransaction()
+{
+    return step("TX_ROLLBACK");
+}
+
+bool Database::step(const string& name)
+{
+    auto stmt = m_statements[name];
+    sqlite3_reset(stmt);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        const char *err_msg = sqlite3_errmsg(m_database);
+        Logger::error(getClassName(), __FUNCTION__, Logger::format("Failed to step %s: %s", name.c_str(), err_msg));
         return false;
     }
-    Logger::debug(getClassName(), __FUNCTION__, Logger::format("Removed: %s, %s", category.c_str(), key.c_str()));
     return true;
 }
 
+void Database::getStatus(JValue& status)
+{
+    status.put("pragmas", m_pragmas.duplicate());
+
+    JValue maintenance = Object();
+    maintenance.put("runs", (long long) m_maintenanceRuns);
+    maintenance.put("mergeSteps", (long long) m_mergeSteps);
+    maintenance.put("optimizeSteps", (long long) m_optimizeSteps);
+    maintenance.put("vacuumedPages", (long long) m_vacuumedPages);
+    maintenance.put("collectedData", (long long) m_collectedData);
+    maintenance.put("spentMs", m_maintenanceMs);
+    maintenance.put("pending", m_needsMaintenance);
+    status.put("maintenance", maintenance);
+}
+
+/**
+ * Maintenance on idle time: no search is running and none is started recently
+ */
+gboolean Database::onMaintenance(gpointer data)
+{
+    Database* db = static_cast<Database*>(data);
+    if (db->m_maintaining || !db->m_needsMaintenance || db->m_searching > 0 ||
+        g_get_monotonic_time() - db->m_lastSearch < MAINTENANCE_QUIET) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    db->m_maintaining = true;
+    int budget = ConfFile::getInstance()->getMaintenanceBudget();
+    db->m_writer.post([db, budget] () {
+        MaintenanceStep step = db->maintain(budget);
+        toMainLoop([db, step] () {
+            db->maintained(step);
+        });
+    });
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * One step of maintenance on the writer thread, until the budget (ms) is spent or a search comes.
+ *
+ * 1. merge FTS segments a bit, as automerge does
+ * 2. merge all into one, as 'optimize' does (but by pages, not to block long)
+ * 3. remove display/extra not referred by any item (by MAINTENANCE_PAGES rows)
+ * 4. give free pages back to the file system
+ */
+Database::MaintenanceStep Database::maintain(int budget)
+{
+    MaintenanceStep step = { 0, 0, 0, 0, false, 0 };
+    gint64 start = g_get_monotonic_time();
+    gint64 deadline = start + budget * 1000LL;
+    auto canRun = [this, deadline] () {
+        return m_searching == 0 && g_get_monotonic_time() < deadline;
+    };
+
+    // no more work if it changes less than 2 rows (see FTS5 'merge')
+    bool merged = false;
+    while (!merged && canRun()) {
+        int before = sqlite3_total_changes(m_database);
+        if (!execute(Logger::format("INSERT INTO Items(Items, rank) VALUES('merge', %d);", MAINTENANCE_PAGES))) {
+            break;
+        }
+        merged = sqlite3_total_changes(m_database) - before < 2;
+        step.merges += merged ? 0 : 1;
+    }
+
+    bool optimized = false;
+    while (merged && !optimized && canRun()) {
+        int before = sqlite3_total_changes(m_database);
+        if (!execute(Logger::format("INSERT INTO Items(Items, rank) VALUES('merge', %d);", -MAINTENANCE_PAGES))) {
+            break;
+        }
+        optimized = sqlite3_total_changes(m_database) - before < 2;
+        step.optimizes += optimized ? 0 : 1;
+    }
+
+    // display/extra not referred anymore (removed or replaced items), before giving pages back.
+    // rows removed by each statement are limited, but each one reads all ItemKeys
+    bool collected = false;
+    while (optimized && !collected && canRun()) {
+        auto stmt = m_statements["DATA_COLLECT"];
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, MAINTENANCE_PAGES);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            break;
+        }
+        int changes = sqlite3_changes(m_database);
+        step.collected += changes;
+        collected = changes < MAINTENANCE_PAGES;
+    }
+
+    // stop when nothing is given back (e.g. auto_vacuum is not applied)
+    bool vacuumed = false;
+    while (collected && !vacuumed && canRun()) {
+        int before = atoi(getPragma(m_database, "freelist_count").c_str());
+        if (before <= 0 || !execute(Logger::format("PRAGMA incremental_vacuum(%d);", MAINTENANCE_PAGES))) {
+            vacuumed = true;
+            break;
+        }
+        int after = atoi(getPragma(m_database, "freelist_count").c_str());
+        if (after >= before) {
+            vacuumed = true;
+            break;
+        }
+        step.vacuumedPages += before - after;
+    }
+
+    step.finished = vacuumed;
+    step.spentMs = (g_get_monotonic_time() - start) / 1000.0;
+    return step;
+}
+
+void Database::maintained(const MaintenanceStep& step)
+{
+    m_maintaining = false;
+    m_maintenanceRuns++;
+    m_mergeSteps += step.merges;
+    m_optimizeSteps += step.optimizes;
+    m_vacuumedPages += step.vacuumedPages;
+    m_collectedData += step.collected;
+    m_maintenanceMs += step.spentMs;
+
+    // next tick continues it if it's not finished
+    if (step.finished) {
+        m_needsMaintenance = false;
+    }
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Maintenance %s: merge %d, optimize %d, collect %d, vacuum %d page(s), %.1fms",
+        (step.finished ? "finished" : "paused"), step.merges, step.optimizes, step.collected, step.vacuumedPages, step.spentMs));
+}
+
+void Database::write(function<bool()> job, doneCB done)
+{
+    // 'done' is released on the main loop, not on the writer thread
+    doneCB* callback = done ? new doneCB(std::move(done)) : nullptr;
+    m_writer.post([job, callback] () {
+        bool success = job();
+        if (callback) {
+            toMainLoop([callback, success] () {
+                (*callback)(success);
+                delete callback;
+            });
+        }
+    });
+}
+
+void Database::writeItems(function<bool()> job, doneCB done)
+{
+    // searches started after this see new items, results cached before are invalid
+    write(std::move(job), [this, done] (bool success) {
+        notifyChanged();
+        m_needsMaintenance = true;
+        if (done) {
+            done(success);
+        }
+    });
+}
+
+void Database::toMainLoop(function<void()> func)
+{
+    g_idle_add_full(G_PRIORITY_DEFAULT, [] (gpointer data) -> gboolean {
+        (*static_cast<function<void()>*>(data))();
+        return G_SOURCE_REMOVE;
+    }, new function<void()>(std::move(func)), [] (gpointer data) {
+        delete static_cast<function<void()>*>(data);
+    });
+}
+
+Database::Worker::Worker(const string& name)
+    : m_name(name)
+    , m_stopped(false)
+    , m_drain(false)
+{
+}
+
+void Database::Worker::start()
+{
+    m_thread = thread(&Worker::run, this);
+}
+
+void Database::Worker::stop(bool drain)
+{
+    queue<function<void()>> dropped;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopped = true;
+        m_drain = drain;
+        if (!drain) {
+            // released here (main loop), not on the thread
+            swap(dropped, m_jobs);
+        }
+    }
+    m_condition.notify_all();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    Logger::info("Database", __FUNCTION__, Logger::format("Stopped %s: %zu job(s) dropped", m_name.c_str(), dropped.size()));
+}
+
+void Database::Worker::post(function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_jobs.push(std::move(job));
+    }
+    m_condition.notify_one();
+}
+
+void Database::Worker::run()
+{
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopped || !m_jobs.empty(); });
+            if (m_jobs.empty() || (m_stopped && !m_drain)) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop();
+        }
+        job();
+    }
+}
+
 bool Database::search(const string& searchKey, searchCB callback)
 {
-    vector<SearchItemPtr> searchedItems;
+    return search(make_shared<SearchQuery>(searchKey), std::move(callback));
+}
 
-    auto stmt = m_statements["ITEM_SELECT"];
-    auto key = searchKey + "*";
-    sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char* cateId = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        const char* display = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        const char* extra = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-
-        SearchItemPtr item;
-        JValue dispObj = JDomParser::fromString(display);
-        if (extra && strlen(extra) >= 2) {
-            item = make_shared<SearchItem>(cateId, key, value, dispObj, JDomParser::fromString(extra));
-        } else {
-            item = make_shared<SearchItem>(cateId, key, value, dispObj);
+/**
+ * Same as the match query: all words but last are tokens, last is a prefix of a token.
+ */
+bool Database::refine(const string& key, const vector<SearchItemPtr>& items, vector<bool>& matched)
+{
+    vector<string> words;
+    for (char c : key) {
+        if (static_cast<unsigned char>(c) >= 0x80 || (!isalnum(c) && !isspace(c))) {
+            return false;
+        }
+    }
+    if (!toAsciiTokens(key, words) || words.empty()) {
+        return false;
+    }
+
+    matched.assign(items.size(), false);
+    for (size_t i = 0; i < items.size(); i++) {
+        vector<string> tokens;
+        if (!toAsciiTokens(items[i]->getValue(), tokens)) {
+            return false;
         }
-        searchedItems.push_back(item);
+
+        bool allFound = true;
+        for (size_t w = 0; allFound && w < words.size(); w++) {
+            const string& word = words[w];
+            bool isLast = (w == words.size() - 1);
+            allFound = any_of(tokens.begin(), tokens.end(), [&word, isLast] (const string& token) {
+                return isLast ? token.compare(0, word.size(), word) == 0 : token == word;
+            });
+        }
+        matched[i] = allFound;
+    }
+    return true;
+}
+
+bool Database::search(SearchQueryPtr query, searchCB callback)
+{
+    return searchChunks(std::move(query), make_shared<SearchToken>(), collect(std::move(callback)));
+}
+
+// on the reader thread, non-zero interrupts the step
+int Database::onSearchProgress(void* data)
+{
+    return (*static_cast<SearchTokenPtr*>(data))->isCancelled() ? 1 : 0;
+}
+
+/**
+ * Search on the reader thread, parts are given on the main loop in order
+ */
+bool Database::searchChunks(SearchQueryPtr query, SearchTokenPtr token, chunkCB callback)
+{
+    const string sourceId = getId();
+    const string searchKey = query->getKey();
+
+    // nothing to match (e.g. only spaces)
+    string key = toMatchQuery(searchKey);
+    if (key.empty()) {
+        callback(sourceId, vector<SearchItemPtr>(), vector<string>(), true, false);
+        return true;
     }
 
-    Logger::info(getClassName(), __FUNCTION__, Logger::format("Find '%s' => %d item(s) on %s", searchKey.c_str(), searchedItems.size(), getId().c_str()));
-    callback(getId(), std::move(searchedItems));
+    // filter and order categories as the query, not to read rows of others (empty = all)
+    string categories;
+    if (!query->getCategories().empty()) {
+        JValue cateArr = Array();
+        for (auto& cateId : query->getCategories()) {
+            cateArr.append(cateId);
+        }
+        categories = cateArr.stringify();
+    }
+    int maxItems = query->getMaxItems();
+    int limit = query->getLimit() > 0 ? query->getLimit() : -1;
+    string cursor = query->getCursor(sourceId);
+
+    // they're released by the last part on the main loop, not on the reader thread
+    auto chunkCallback = new chunkCB(std::move(callback));
+    auto chunkToken = new SearchTokenPtr(std::move(token));
+    auto deliver = [this, chunkCallback, chunkToken, sourceId] (vector<SearchItemPtr>& items, vector<string>& cursors, bool done, bool failed) {
+        auto chunk = new vector<SearchItemPtr>(std::move(items));
+        auto chunkCursors = new vector<string>(std::move(cursors));
+        items.clear();
+        cursors.clear();
+        toMainLoop([this, chunkCallback, chunkToken, sourceId, chunk, chunkCursors, done, failed] () {
+            if (done) {
+                m_searching--;
+            }
+            (*chunkCallback)(sourceId, std::move(*chunk), std::move(*chunkCursors), done, failed);
+            delete chunk;
+            delete chunkCursors;
+            if (done) {
+                m_searchTokens.erase(*chunkToken);
+                delete chunkCallback;
+                delete chunkToken;
+            }
+        });
+    };
+
+    // maintenance waits it
+    m_searching++;
+    m_lastSearch = g_get_monotonic_time();
+    m_searchTokens.insert(*chunkToken);
+
+    m_reader.post([this, searchKey, key, categories, maxItems, limit, cursor, chunkToken, deliver] () {
+        vector<SearchItemPtr> searchedItems;
+        vector<string> cursors;
+
+        // superseded or expired while waiting previous ones, don't run it
+        if ((*chunkToken)->isCancelled()) {
+            Logger::info(getClassName(), "searchChunks", Logger::format("Cancelled '%s' before searching", searchKey.c_str()));
+            deliver(searchedItems, cursors, true, true);
+            return;
+        }
+        // the first step does most of the work (matching and ranking all), interrupt it too
+        sqlite3_progress_handler(m_readDatabase, SEARCH_PROGRESS_OPS, onSearchProgress, chunkToken);
+
+        // ordered by category rank and relevance (bm25 on 'text' column), top 'maxItems' per category and 'limit' in total
+        auto stmt = m_searchStatement;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+        if (!categories.empty()) {
+            sqlite3_bind_text(stmt, 2, categories.c_str(), -1, SQLITE_STATIC);
+        } else {
+            sqlite3_bind_null(stmt, 2);
+        }
+        sqlite3_bind_int(stmt, 3, maxItems);
+        sqlite3_bind_int(stmt, 4, limit);
+
+        // resume after the cursor (category rank, score, rowid)
+        long long crank = 0, rowid = 0;
+        double score = 0;
+        if (!cursor.empty() && sscanf(cursor.c_str(), "%lld,%lf,%lld", &crank, &score, &rowid) == 3) {
+            sqlite3_bind_int64(stmt, 5, crank);
+            sqlite3_bind_double(stmt, 6, score);
+            sqlite3_bind_int64(stmt, 7, rowid);
+        } else {
+            sqlite3_bind_null(stmt, 5);
+            sqlite3_bind_null(stmt, 6);
+            sqlite3_bind_null(stmt, 7);
+        }
+
+        int count = 0;
+        int result;
+        while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const char* cateId = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            const char* display = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            const char* extra = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+
+            SearchItemPtr item;
+            JValue dispObj = JDomParser::fromString(display);
+            if (extra && strlen(extra) >= 2) {
+                item = make_shared<SearchItem>(cateId, key, value, dispObj, JDomParser::fromString(extra));
+            } else {
+                item = make_shared<SearchItem>(cateId, key, value, dispObj);
+            }
+            searchedItems.push_back(item);
+            cursors.push_back(Logger::format("%lld,%.17g,%lld",
+                (long long) sqlite3_column_int64(stmt, 5), sqlite3_column_double(stmt, 6), (long long) sqlite3_column_int64(stmt, 7)));
+            count++;
+
+            // give a part, intents of it can be made while reading next rows
+            if (searchedItems.size() >= SEARCH_CHUNK_SIZE) {
+                deliver(searchedItems, cursors, false, false);
+                if ((*chunkToken)->isCancelled()) {
+                    break;
+                }
+            }
+        }
+        sqlite3_progress_handler(m_readDatabase, 0, nullptr, nullptr);
+
+        // items are missing if it's stopped by an error (e.g. busy) or by the token (it can be expired only)
+        bool failed = result != SQLITE_DONE;
+        bool cancelled = failed && (*chunkToken)->isCancelled();
+        if (cancelled) {
+            Logger::info(getClassName(), "searchChunks", Logger::format("Stopped '%s' after %d item(s)", searchKey.c_str(), count));
+        } else if (failed) {
+            Logger::error(getClassName(), "searchChunks", Logger::format("Failed to search '%s': %s", searchKey.c_str(), sqlite3_errmsg(m_readDatabase)));
+        }
+        // end the read transaction, not to block checkpoints
+        sqlite3_reset(stmt);
+
+        Logger::info(getClassName(), "searchChunks", Logger::format("Find '%s' => %d item(s) on %s", searchKey.c_str(), count, getId().c_str()));
+        deliver(searchedItems, cursors, true, failed);
+    });
     return true;
 }
@@ -17,9 +17,18 @@
 #ifndef BASE_DATABASE_H_
 #define BASE_DATABASE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <queue>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <glib.h>
 #include <sqlite3.h>
 
 #include "Category.h"
@@ -33,33 +42,167 @@
 
 using namespace std;
 
-class Database : public DataSource
+/**
+ * SQLite store of items, categories and fingerprints.
+ *
+ * Writes are done in order on the writer thread, searches on the reader thread
+ * with another connection (WAL, not blocked by writes). Callbacks are called on the main loop.
+ * Categories and fingerprints are on memory, they're written to the file later.
+ */
+class Database : public DataSourceV3
                , public IInitializable<Database>
                , public ISingleton<Database> {
 friend class ISingleton<Database>;
 public:
     virtual ~Database();
 
+    // result of a write, called on the main loop
+    using doneCB = function<void(bool success)>;
+
     bool onInitialization();
     bool onFinalization();
 
     bool adjustOrCreateCategory(CategoryPtr cate);
     bool removeCategory(const string& cateId);
     bool updateCategory(CategoryPtr cate);
-    vector<CategoryPtr> getCategories();
-
-    bool insertItem(const SearchItemPtr& item);
-    bool removeItem(const string& category, const string& key = "");
-
-    bool search(const string& searchKey, searchCB callback);
+    // ordered by rank, kept on memory (don't modify them directly)
+    const vector<CategoryPtr>& getCategories() { return m_categories; }
+    // increased whenever categories are added, removed or updated
+    unsigned long getCategoryGeneration() { return m_categoryGeneration; }
+
+    // false if it's not requested
+    bool insertItem(const SearchItemPtr& item, doneCB done = nullptr);
+    bool insertItems(const vector<SearchItemPtr>& items, doneCB done = nullptr);
+    bool upsertItem(const SearchItemPtr& item, doneCB done = nullptr);
+    bool upsertItems(const vector<SearchItemPtr>& items, doneCB done = nullptr);
+    bool removeItem(const string& category, const string& key = "", doneCB done = nullptr);
+    bool removeItems(const string& category, const vector<string>& keys, doneCB done = nullptr);
+    bool replaceItems(const string& category, const vector<SearchItemPtr>& items, doneCB done = nullptr);
+
+    // fingerprint of the source data indexed for a category (to skip re-indexing)
+    string getFingerprint(const string& category);
+    const map<string, string>& getFingerprints() { return m_fingerprints; }
+    bool setFingerprint(const string& category, const string& value);
+    bool removeFingerprint(const string& category);
+
+    bool search(const string& searchKey, searchCB callback) override;
+    bool search(SearchQueryPtr query, searchCB callback) override;
+    bool searchChunks(SearchQueryPtr query, SearchTokenPtr token, chunkCB callback) override;
+    bool refine(const string& key, const vector<SearchItemPtr>& items, vector<bool>& matched) override;
+
+    // SQLite settings applied and maintenance stats
+    void getStatus(JValue& status);
 
 private:
     Database();
 
+    // jobs run in order on a thread
+    class Worker {
+    public:
+        Worker(const string& name);
+
+        void start();
+        // pending jobs are run before it's stopped if 'drain'
+        void stop(bool drain);
+        void post(function<void()> job);
+
+    private:
+        void run();
+
+        string m_name;
+        thread m_thread;
+        mutex m_mutex;
+        condition_variable m_condition;
+        queue<function<void()>> m_jobs;
+        bool m_stopped;
+        bool m_drain;
+    };
+
+    // copied from SearchItem on the main loop, not to share JValue with the writer thread
+    struct ItemRow {
+        string category;
+        string key;
+        string text;
+        string display;
+        string extra;
+    };
+
+    // done by a maintenance step on the writer thread
+    struct MaintenanceStep {
+        int merges;
+        int optimizes;
+        int collected;
+        int vacuumedPages;
+        bool finished;
+        double spentMs;
+    };
+
+    // runs steps on the writer when no search is running
+    static gboolean onMaintenance(gpointer data);
+    MaintenanceStep maintain(int budget);
+    void maintained(const MaintenanceStep& step);
+
+    static void toMainLoop(function<void()> func);
+    static int onSearchProgress(void* data);
+    // 'job' runs on the writer thread, 'done' gets its result on the main loop
+    void write(function<bool()> job, doneCB done = nullptr);
+    // same with write(), and items are changed after it
+    void writeItems(function<bool()> job, doneCB done);
+
+    bool execute(const string& query);
+    bool setPragma(sqlite3* db, const string& name, const string& value);
+    string getPragma(sqlite3* db, const string& name);
+    int getVersion();
+    bool hasTable(const string& name);
+    bool migrate();
+
+    CategoryPtr findCategory(const string& cateId);
+    void sortCategories();
     bool updateRanks(int value, int start, int end);
-
+    vector<ItemRow> toRows(const vector<SearchItemPtr>& items);
+    bool storeItems(const vector<SearchItemPtr>& items, bool replace, doneCB done);
+    bool storeRows(const vector<ItemRow>& rows, bool replace, size_t total);
+    bool bindItem(const ItemRow& row);
+    sqlite3_int64 storeData(const string& value);
+    bool deleteItems(const string& category, const string& key);
+
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
+    bool step(const string& name);
+
+    // for writes, used only on the writer thread after initialized
     sqlite3* m_database;
     map<string, sqlite3_stmt*> m_statements;
+    Worker m_writer;
+
+    // for searches, used only on the reader thread
+    sqlite3* m_readDatabase;
+    sqlite3_stmt* m_searchStatement;
+    Worker m_reader;
+
+    map<string, string> m_fingerprints;
+    vector<CategoryPtr> m_categories;
+    unsigned long m_categoryGeneration;
+    JValue m_pragmas;
+
+    // searches not finished (read on the writer), and when the last one started
+    atomic<int> m_searching;
+    gint64 m_lastSearch;
+    // tokens of searches not finished, they're cancelled when it's finalized
+    set<SearchTokenPtr> m_searchTokens;
+
+    guint m_maintenanceTimer;
+    bool m_maintaining;
+    // items are changed since the last finished maintenance
+    bool m_needsMaintenance;
+    // stats
+    unsigned long m_maintenanceRuns;
+    unsigned long m_mergeSteps;
+    unsigned long m_optimizeSteps;
+    unsigned long m_vacuumedPages;
+    unsigned long m_collectedData;
+    double m_maintenanceMs;
 };
 
 #endif /* BASE_DATABASE_H_ */
\ No newline at end of file
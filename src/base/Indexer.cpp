@@ -0,0 +1,137 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "base/Indexer.h"
+
+#include "Logger.h"
+
+Indexer::Indexer()
+    : m_stopped(false)
+    , m_sequence(0)
+{
+}
+
+bool Indexer::onInitialization()
+{
+    m_thread = thread(&Indexer::run, this);
+    return true;
+}
+
+bool Indexer::onFinalization()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+    m_condition.notify_all();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    return true;
+}
+
+bool Indexer::request(const string& id, IndexPriority priority, parseFunc parse, doneCB done)
+{
+    if (!isInitalized()) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("Not initialized, ignore: %s", id.c_str()));
+        return false;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        // previous request is not valid anymore
+        auto it = m_jobs.find(id);
+        if (it != m_jobs.end()) {
+            it->second->cancelled = true;
+        }
+
+        auto job = make_shared<IndexJob>(id, priority, ++m_sequence, parse, done);
+        m_jobs[id] = job;
+        m_queue.push(std::move(job));
+    }
+    m_condition.notify_one();
+
+    Logger::debug(getClassName(), __FUNCTION__, Logger::format("Requested: %s (priority %d)", id.c_str(), priority));
+    return true;
+}
+
+bool Indexer::cancel(const string& id)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) {
+        return false;
+    }
+    it->second->cancelled = true;
+    m_jobs.erase(it);
+
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Cancelled: %s", id.c_str()));
+    return true;
+}
+
+void Indexer::run()
+{
+    while (true) {
+        IndexJobPtr job;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopped || !m_queue.empty(); });
+            if (m_stopped) {
+                return;
+            }
+            job = m_queue.top();
+            m_queue.pop();
+        }
+
+        if (job->cancelled) {
+            continue;
+        }
+        job->items = job->parse();
+
+        // store on main loop, but after pending requests (idle priority)
+        g_idle_add(onJobDone, new IndexJobPtr(std::move(job)));
+    }
+}
+
+gboolean Indexer::onJobDone(gpointer data)
+{
+    IndexJobPtr* jobPtr = static_cast<IndexJobPtr*>(data);
+    IndexJobPtr job = std::move(*jobPtr);
+    delete jobPtr;
+
+    auto indexer = getInstance();
+    {
+        lock_guard<mutex> lock(indexer->m_mutex);
+        auto it = indexer->m_jobs.find(job->id);
+        if (it != indexer->m_jobs.end() && it->second == job) {
+            indexer->m_jobs.erase(it);
+        }
+    }
+
+    // cancelled while parsing
+    if (job->cancelled) {
+        Logger::info(getClassName(), __FUNCTION__, Logger::format("Dropped: %s", job->id.c_str()));
+        return G_SOURCE_REMOVE;
+    }
+
+    if (job->done) {
+        job->done(std::move(job->items));
+    }
+    return G_SOURCE_REMOVE;
+}
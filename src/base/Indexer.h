@@ -0,0 +1,108 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef BASE_INDEXER_H_
+#define BASE_INDEXER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <glib.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SearchItem.h"
+
+#include "interface/IInitializable.h"
+#include "interface/ISingleton.h"
+
+using namespace std;
+
+enum IndexPriority {
+    IndexPriority_HIGH,     // requested by user (e.g. app installed)
+    IndexPriority_NORMAL,   // background (e.g. boot)
+};
+
+/**
+ * Parses index sources on a worker thread, not to block the main loop.
+ *
+ * Jobs are run by priority (FIFO in same priority), and the parsed items
+ * are delivered to the main loop to be stored.
+ */
+class Indexer : public IInitializable<Indexer>
+              , public ISingleton<Indexer> {
+friend class ISingleton<Indexer>;
+public:
+    virtual ~Indexer() {}
+
+    bool onInitialization();
+    bool onFinalization();
+
+    // 'parse' runs on worker thread, 'done' runs on main loop
+    using parseFunc = function<vector<SearchItemPtr>()>;
+    using doneCB = function<void(vector<SearchItemPtr>)>;
+
+    // request job of the id, replace the pending one of the same id
+    bool request(const string& id, IndexPriority priority, parseFunc parse, doneCB done);
+    bool cancel(const string& id);
+
+private:
+    Indexer();
+
+    class IndexJob {
+    public:
+        IndexJob(const string& i, IndexPriority p, unsigned long s, parseFunc& pf, doneCB& cb)
+            : id(i), priority(p), sequence(s), parse(std::move(pf)), done(std::move(cb)), cancelled(false) {}
+        string id;
+        IndexPriority priority;
+        unsigned long sequence;
+        parseFunc parse;
+        doneCB done;
+        atomic<bool> cancelled;
+        vector<SearchItemPtr> items;
+    };
+    typedef shared_ptr<IndexJob> IndexJobPtr;
+
+    struct JobCompare {
+        bool operator()(const IndexJobPtr& a, const IndexJobPtr& b) const
+        {
+            if (a->priority != b->priority) {
+                return a->priority > b->priority;
+            }
+            return a->sequence > b->sequence;
+        }
+    };
+
+    static gboolean onJobDone(gpointer data);
+
+    void run();
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_condition;
+    bool m_stopped;
+
+    priority_queue<IndexJobPtr, vector<IndexJobPtr>, JobCompare> m_queue;
+    map<string, IndexJobPtr> m_jobs;
+    unsigned long m_sequence;
+};
+
+#endif /* BASE_INDEXER_H_ */
@@ -0,0 +1,134 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "base/SearchCache.h"
+
+#include "util/Time.h"
+#include "Logger.h"
+
+// rough memory of an intent except its strings (objects, JSON values)
+static const size_t INTENT_SIZE_HINT = 512;
+
+SearchCache::SearchCache()
+    : m_bytes(0)
+    , m_maxEntries(0)
+    , m_maxBytes(0)
+    , m_ttl(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+}
+
+void SearchCache::setBounds(size_t maxEntries, size_t maxBytes, double ttl)
+{
+    m_maxEntries = maxEntries;
+    m_maxBytes = maxBytes;
+    m_ttl = ttl;
+    evict();
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Entries: %zu, Bytes: %zu, TTL: %.1f", maxEntries, maxBytes, ttl));
+}
+
+bool SearchCache::get(const string& key, const Generations& generations, map<string, vector<IntentPtr>>& intents, SearchQueryPtr& next)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        m_misses++;
+        return false;
+    }
+
+    // source changed or too old
+    auto entry = it->second;
+    if (entry->generations != generations || (m_ttl > 0 && Time::getCurrentTime() - entry->created > m_ttl)) {
+        m_bytes -= entry->size;
+        m_entries.erase(entry);
+        m_index.erase(it);
+        m_misses++;
+        return false;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+    intents = entry->intents;
+    next = entry->next;
+    m_hits++;
+    return true;
+}
+
+void SearchCache::put(const string& key, const Generations& generations, const map<string, vector<IntentPtr>>& intents, SearchQueryPtr next)
+{
+    if (m_maxEntries == 0 || m_maxBytes == 0) {
+        return;
+    }
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_bytes -= it->second->size;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    size_t size = estimateSize(key, intents);
+    if (size > m_maxBytes) {
+        Logger::debug(getClassName(), __FUNCTION__, Logger::format("Too big to cache: %zu", size));
+        return;
+    }
+
+    m_entries.push_front({ key, generations, Time::getCurrentTime(), size, intents, std::move(next) });
+    m_index[key] = m_entries.begin();
+    m_bytes += size;
+    evict();
+}
+
+void SearchCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void SearchCache::getStatus(JValue& status)
+{
+    status.put("entries", (int) m_entries.size());
+    status.put("bytes", (int) m_bytes);
+    status.put("maxEntries", (int) m_maxEntries);
+    status.put("maxBytes", (int) m_maxBytes);
+    status.put("hits", (int) m_hits);
+    status.put("misses", (int) m_misses);
+    status.put("evictions", (int) m_evictions);
+}
+
+size_t SearchCache::estimateSize(const string& key, const map<string, vector<IntentPtr>>& intents)
+{
+    size_t size = sizeof(Entry) + key.size();
+    for (auto& it : intents) {
+        size += it.first.size();
+        for (auto& intent : it.second) {
+            size += INTENT_SIZE_HINT + intent->getUri().size();
+        }
+    }
+    return size;
+}
+
+void SearchCache::evict()
+{
+    // least recently used first
+    while (!m_entries.empty() && (m_entries.size() > m_maxEntries || m_bytes > m_maxBytes)) {
+        m_bytes -= m_entries.back().size;
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+        m_evictions++;
+    }
+}
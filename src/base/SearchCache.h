@@ -0,0 +1,85 @@
+// Copyright (c) 2020 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef BASE_SEARCHCACHE_H_
+#define BASE_SEARCHCACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <pbnjson.hpp>
+
+#include "Intent.h"
+#include "SearchQuery.h"
+
+#include "interface/IClassName.h"
+
+using namespace std;
+using namespace pbnjson;
+
+/**
+ * LRU cache of merged search results.
+ *
+ * An entry is valid while the generations of all sources are same with
+ * the ones when it's stored, and it's not older than TTL.
+ */
+class SearchCache : public IClassName<SearchCache> {
+public:
+    // source id => generation
+    using Generations = map<string, unsigned long>;
+
+    SearchCache();
+    virtual ~SearchCache() {}
+
+    // maxEntries or maxBytes = 0 disables the cache
+    void setBounds(size_t maxEntries, size_t maxBytes, double ttl);
+
+    bool get(const string& key, const Generations& generations, map<string, vector<IntentPtr>>& intents, SearchQueryPtr& next);
+    void put(const string& key, const Generations& generations, const map<string, vector<IntentPtr>>& intents, SearchQueryPtr next);
+    void clear();
+
+    void getStatus(JValue& status);
+
+private:
+    struct Entry {
+        string key;
+        Generations generations;
+        double created;
+        size_t size;
+        map<string, vector<IntentPtr>> intents;
+        SearchQueryPtr next;
+    };
+
+    static size_t estimateSize(const string& key, const map<string, vector<IntentPtr>>& intents);
+
+    void evict();
+
+    // front is the most recently used
+    list<Entry> m_entries;
+    map<string, list<Entry>::iterator> m_index;
+    size_t m_bytes;
+
+    size_t m_maxEntries;
+    size_t m_maxBytes;
+    double m_ttl;
+
+    unsigned long m_hits;
+    unsigned long m_misses;
+    unsigned long m_evictions;
+};
+
+#endif /* BASE_SEARCHCACHE_H_ */
@@ -14,19 +14,36 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <dlfcn.h>
 
 #include "Plugin.h"`
 
 #include "base/SearchManager.h"
 #include "base/Database.h"
+#include "base/Indexer.h"
 
+#include "bus/client/SettingService.h"
 #include "conf/ConfFile.h"
 #include "util/File.h"
+#include "util/Time.h"
 #include "Logger.h"
 
+// previous results kept for refinement
+static const size_t MAX_SESSIONS = 8;
+static const size_t SESSION_MAX_ITEMS = 1000;
+
+// zero-hit keys kept per source
+static const size_t MAX_NEGATIVES = 32;
+
 bool SearchManager::onInitialization()
 {
+    auto conf = ConfFile::getInstance();
+    m_cache.setBounds(max(conf->getCacheMaxEntries(), 0), max(conf->getCacheMaxBytes(), 0), conf->getCacheTTL());
+
     loadPlugins();
     return true;
 }
@@ -54,7 +71,15 @@ bool SearchManager::addSearchSet(SearchSetPtr searchSet)
 
     searchSet->setClient(this);
     m_searchSets.insert({id, searchSet});
-    Logger::info(getClassName(), __FUNCTION__, Logger::format("SearchSet added: %s", id.c_str()));
+
+    // results of the source are invalid when it's changed
+    auto v2 = dynamic_pointer_cast<DataSourceV2>(searchSet->getDataSource());
+    if (v2) {
+        v2->setChangedCallback([this] (const string& sourceId) {
+            m_generations[sourceId]++;
+        });
+    }
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("SearchSet added: %s (api %d)", id.c_str(), searchSet->getDataSource()->getApiVersion()));
 
     // register categories to DB
     auto categories = searchSet->getCategories();
@@ -73,8 +98,12 @@ bool SearchManager::removeSearchSet(const string& id)
         return false;
     }
 
-    m_searchSets.erase(id);
+    auto v2 = dynamic_pointer_cast<DataSourceV2>(it->second->getDataSource());
+    if (v2) {
+        v2->setChangedCallback(nullptr);
+    }
     it->second->setClient(nullptr);
+    m_searchSets.erase(it);
     Logger::info(getClassName(), __FUNCTION__, Logger::format("SearchSet removed: %s", id.c_str()));
     return true;
 }
@@ -86,6 +115,8 @@ void SearchManager::categoryAdded(CategoryPtr category)
 
 void SearchManager::categoryRemoved(const string& cateId)
 {
+    // don't store indexes of removed one
+    Indexer::getInstance()->cancel(cateId);
     Database::getInstance()->removeCategory(cateId);
 }
 
@@ -111,78 +142,700 @@ CategoryPtr SearchManager::findCategory(const string& id)
 }
 
 
-bool SearchManager::search(const string& searchKey, resultCB callback)
+bool SearchManager::search(SearchQueryPtr request, resultCB callback, progressCB progress, cancelCB cancelled)
 {
-    shared_ptr<SearchTask> task = make_shared<SearchTask>(searchKey, callback);
+    const string& searchKey = request->getKey();
+
+    // the client doesn't wait previous one anymore
+    const string& sessionId = request->getSession();
+    if (!sessionId.empty()) {
+        auto running = m_runnings.find(sessionId);
+        if (running != m_runnings.end()) {
+            auto previous = running->second.lock();
+            m_runnings.erase(running);
+            if (previous) {
+                previous->cancel();
+            }
+        }
+    }
+
+    // same query on same sources, give previous results
+    string cacheKey = toCacheKey(request);
+    auto generations = getGenerations();
+    map<string, vector<IntentPtr>> intents;
+    SearchQueryPtr next;
+    if (m_cache.get(cacheKey, generations, intents, next)) {
+        Logger::debug(getClassName(), __FUNCTION__, Logger::format("Cache hit: %s", searchKey.c_str()));
+        callback(std::move(intents), std::move(next), vector<string>());
+        return true;
+    }
+
+    shared_ptr<SearchTask> task = make_shared<SearchTask>(request, callback, cacheKey, generations);
+    task->setDeadline(request->getTimeout() > 0 ? request->getTimeout() : ConfFile::getInstance()->getSearchTimeout());
+    task->setProgress(std::move(progress));
+    task->setCancelled(std::move(cancelled));
+    task->setSerial(++m_serial);
+    if (!sessionId.empty()) {
+        m_runnings[sessionId] = task;
+    }
+
+    // the key extends previous one of the session, its results can be filtered
+    Session* session = nullptr;
+    auto found = m_sessions.find(sessionId);
+    if (found != m_sessions.end() && found->second.conditions == toConditions(request)) {
+        const string& prevKey = found->second.key;
+        string key = normalizeKey(searchKey);
+        if (key.compare(0, prevKey.size(), prevKey) == 0) {
+            session = &found->second;
+        }
+    }
 
     // from each source
     for (auto& it : m_searchSets) {
         auto& id = it.first;
         auto searchSet = it.second;
         auto source = searchSet->getDataSource();
-
-        // check searchSet's categories are enabled, it's all disabled, don't search the source.
-        bool enabled = false;
-        for (auto& it : searchSet->getCategories()) {
-            if (it.second->isEnabled()) {
-                enabled = true;
-                break;
+        const string sourceId = source->getId();
+
+        // only enabled and requested categories are searched on the source (in rank order)
+        auto query = make_shared<SearchQuery>(searchKey);
+        query->setMaxItems(request->getMaxItems());
+        map<string, CategoryPtr> targets;
+        for (auto& rank : Database::getInstance()->getCategories()) {
+            const string& cateId = rank->getCategoryId();
+            auto category = searchSet->findCategory(cateId);
+            if (!category || !category->isEnabled() || !request->isTarget(cateId)) {
+                continue;
             }
+            query->addCategory(cateId);
+            targets.insert({cateId, category});
         }
-        if (!enabled) {
-            Logger::info(getClassName(), __FUNCTION__, Logger::format("SearchSet '%s' is disabled totally.", id.c_str()));
+        if (targets.empty()) {
+            Logger::debug(getClassName(), __FUNCTION__, Logger::format("SearchSet '%s' has no category to search.", id.c_str()));
             continue;
         }
 
-        // try to search
-        source->search(searchKey, [this, task, &searchSet] (const string& sourceId, vector<SearchItemPtr> items) {
+        if (session && refine(*session, source, request, task)) {
+            continue;
+        }
+
+        // positions of refined results are meaningless on the source (told as expired before)
+        unsigned long serial = 0;
+        if (toSerial(getCursor(request, sourceId), serial)) {
+            Logger::warning(getClassName(), __FUNCTION__, Logger::format("Refined results of %s are gone: %s", sourceId.c_str(), searchKey.c_str()));
+            task->setFailed(sourceId);
+            continue;
+        }
+
+        // extends a key found nothing, don't need to search
+        if (request->getCursors().find(sourceId) == request->getCursors().end() && isNegative(source, query)) {
+            Logger::debug(getClassName(), __FUNCTION__, Logger::format("No item on %s: %s", sourceId.c_str(), searchKey.c_str()));
+            task->setComplete(sourceId);
+            continue;
+        }
+
+        // the source resumes on its own cursor, or it's skipped here (see below).
+        // position is given for items without cursors, then all items of the source are paged by position
+        int skip = 0;
+        string cursor = getCursor(request, sourceId);
+        bool byPosition = toPosition(cursor, skip);
+        if (!byPosition && !cursor.empty()) {
+            query->setCursor(sourceId, cursor);
+        }
+
+        // one more item than needed, to know there is the next page
+        if (request->getLimit() > 0) {
+            long long limit = (long long)skip + request->getOffset() + request->getLimit() + 1;
+            query->setLimit((int)min(limit, (long long)INT_MAX));
+        }
+
+        // try to search, intents are made for each part as it comes
+        unsigned long generation = getGeneration(sourceId);
+        auto positionals = make_shared<vector<pair<SearchItemPtr, IntentPtr>>>();
+        auto counts = make_shared<map<string, int>>();
+        auto total = make_shared<int>(0);
+        task->start(sourceId);
+        bool started = searchSource(source, query, task->getToken(), [this, task, targets, query, skip, byPosition, generation, positionals, counts, total] (const string& sourceId, vector<SearchItemPtr> items, vector<string> cursors, bool done, bool failed) {
+            // too late, already responded
+            if (task->isFinished()) {
+                Logger::info(getClassName(), __FUNCTION__, Logger::format("Dropped late results of %s: %zu", sourceId.c_str(), items.size()));
+                return;
+            }
+
             // for each items
-            for (auto item : items) {
+            for (size_t i = 0; i < items.size(); i++) {
+                auto& item = items[i];
+                const string cursor = i < cursors.size() ? cursors[i] : "";
                 const string &cateId = item->getCategory();
-                CategoryPtr category = searchSet->findCategory(cateId);
-                if (!category) {
-                    Logger::warning(getClassName(), __FUNCTION__, Logger::format("Ignore '%s': There is no %s category.",
-                        item->getKey().c_str(),
-                        cateId.c_str()));
-                    continue;
-                } else if (!category->isEnabled()) {
+                (*counts)[cateId]++;
+                (*total)++;
+                // sources not filtering categories can give others
+                auto target = targets.find(cateId);
+                if (target == targets.end()) {
                     continue;
                 }
 
-                // convert to intent and add to list
-                auto intent = category->generateIntent(item);
-                task->get(cateId).push_back(intent);
+                // convert to intent and add to list (sources not giving cursors, after all parts)
+                auto intent = target->second->generateIntent(item);
+                if (byPosition || cursor.empty()) {
+                    positionals->push_back({item, intent});
+                } else {
+                    task->add(sourceId, item, intent, cursor);
+                }
 
                 Logger::debug(getClassName(), __FUNCTION__, Logger::format("Item: %s, %s", cateId.c_str(), item->getKey().c_str()));
             }
+            if (!done) {
+                return;
+            }
+
+            // items without cursors (or all, see above) are paged by position, in category rank order
+            const auto& order = query->getCategories();
+            stable_sort(positionals->begin(), positionals->end(), [&order] (const pair<SearchItemPtr, IntentPtr>& a, const pair<SearchItemPtr, IntentPtr>& b) {
+                return find(order.begin(), order.end(), a.first->getCategory()) < find(order.begin(), order.end(), b.first->getCategory());
+            });
+            for (size_t i = skip; i < positionals->size(); i++) {
+                auto& positional = (*positionals)[i];
+                task->add(sourceId, positional.first, positional.second, Logger::format("#%zu", i + 1));
+            }
+
+            // some of items are missing, the result shouldn't be kept.
+            // the token can be expired before the deadline timer finishes the task
+            if (failed || task->getToken()->isCancelled()) {
+                task->setFailed(sourceId);
+                task->done(sourceId);
+                return;
+            }
+
+            // not cut by any limits, it has all matched items
+            int maxItems = query->getMaxItems();
+            bool complete = skip == 0 && query->getCursors().empty();
+            complete = complete && (query->getLimit() <= 0 || *total < query->getLimit());
+            complete = complete && (maxItems <= 0 || all_of(counts->begin(), counts->end(), [maxItems] (const pair<const string, int>& count) {
+                return count.second < maxItems;
+            }));
+            if (complete) {
+                task->setComplete(sourceId);
+            }
+            if (complete && *total == 0) {
+                addNegative(sourceId, generation, query);
+            }
+            task->done(sourceId);
         });
+        if (!started) {
+            Logger::warning(getClassName(), __FUNCTION__, Logger::format("Failed to search on %s: %s", sourceId.c_str(), searchKey.c_str()));
+            task->setFailed(sourceId);
+            task->done(sourceId);
+        }
     }
 
     return true;
 }
 
-SearchManager::SearchTask::SearchTask(const string& key, resultCB cb)
-    : m_key(key)
+/**
+ * Filter previous complete results of the source for the extended key.
+ *
+ * It's in the order of previous results (not re-ranked by the new key),
+ * and next pages of it are refined also (paged by position).
+ */
+bool SearchManager::refine(Session& session, DataSourcePtr source, SearchQueryPtr request, shared_ptr<SearchTask> task)
+{
+    const string sourceId = source->getId();
+    auto previous = session.sources.find(sourceId);
+    auto generation = session.generations.find(sourceId);
+    auto v2 = dynamic_pointer_cast<DataSourceV2>(source);
+    if (!v2 || previous == session.sources.end() || generation == session.generations.end() || generation->second != getGeneration(sourceId)) {
+        return false;
+    }
+
+    // only position is known for refined results, on the set of the session given it ('#position@serial')
+    int skip = 0;
+    unsigned long serial = 0;
+    string cursor = getCursor(request, sourceId);
+    if (!cursor.empty() && (!toSerial(cursor, serial) || serial != session.serial || !toPosition(cursor, skip))) {
+        return false;
+    }
+
+    vector<SearchItemPtr> items;
+    for (auto& it : previous->second) {
+        items.push_back(it.first);
+    }
+    vector<bool> matched;
+    if (!v2->refine(normalizeKey(request->getKey()), items, matched)) {
+        return false;
+    }
+
+    int maxItems = request->getMaxItems();
+    map<string, int> counts;
+    int position = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!matched[i]) {
+            continue;
+        }
+        int& count = counts[items[i]->getCategory()];
+        bool visible = maxItems <= 0 || count++ < maxItems;
+        if (visible) {
+            position++;
+        }
+        visible = visible && position > skip;
+        task->add(sourceId, items[i], previous->second[i].second, Logger::format("#%d@%lu", position, task->getSerial()), visible);
+    }
+    task->setComplete(sourceId);
+
+    Logger::debug(getClassName(), __FUNCTION__, Logger::format("Refined '%s' on %s: %zu => %d", request->getKey().c_str(), sourceId.c_str(), items.size(), position));
+    return true;
+}
+
+/**
+ * Forget the running search of the session, if it's not replaced by a newer one
+ */
+void SearchManager::cancel(SearchQueryPtr request)
+{
+    auto it = m_runnings.find(request->getSession());
+    if (it == m_runnings.end()) {
+        return;
+    }
+    auto running = it->second.lock();
+    if (running && running->getRequest() != request) {
+        return;
+    }
+    m_runnings.erase(it);
+    if (running) {
+        running->cancel();
+    }
+}
+
+void SearchManager::removeRunning(const string& sessionId, SearchTask* task)
+{
+    auto it = m_runnings.find(sessionId);
+    if (it == m_runnings.end()) {
+        return;
+    }
+    auto running = it->second.lock();
+    if (!running || running.get() == task) {
+        m_runnings.erase(it);
+    }
+}
+
+void SearchManager::saveSession(const string& id, Session session)
+{
+    // don't keep big ones
+    for (auto it = session.sources.begin(); it != session.sources.end();) {
+        if (it->second.size() > SESSION_MAX_ITEMS) {
+            it = session.sources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    session.used = Time::getCurrentTime();
+    m_sessions[id] = std::move(session);
+
+    // remove least recently used one
+    if (m_sessions.size() > MAX_SESSIONS) {
+        auto oldest = min_element(m_sessions.begin(), m_sessions.end(), [] (const pair<const string, Session>& a, const pair<const string, Session>& b) {
+            return a.second.used < b.second.used;
+        });
+        m_sessions.erase(oldest);
+    }
+}
+
+string SearchManager::toCategories(SearchQueryPtr query)
+{
+    string categories;
+    for (auto& cateId : query->getCategories()) {
+        categories += cateId + '\n';
+    }
+    return categories;
+}
+
+bool SearchManager::isNegative(DataSourcePtr source, SearchQueryPtr query)
+{
+    auto found = m_negatives.find(source->getId());
+    if (found == m_negatives.end()) {
+        return false;
+    }
+
+    string key = normalizeKey(query->getKey());
+    string categories = toCategories(query);
+    double ttl = ConfFile::getInstance()->getCacheTTL();
+    double now = Time::getCurrentTime();
+    auto& negatives = found->second;
+    for (auto it = negatives.begin(); it != negatives.end();) {
+        // source changed (or too old, for sources not telling changes)
+        if (it->generation != getGeneration(source->getId()) || (ttl > 0 && now - it->created > ttl)) {
+            it = negatives.erase(it);
+            continue;
+        }
+        if (it->categories == categories && key.compare(0, it->key.size(), it->key) == 0) {
+            return true;
+        }
+        ++it;
+    }
+    return false;
+}
+
+void SearchManager::addNegative(const string& sourceId, unsigned long generation, SearchQueryPtr query)
+{
+    // every key extends empty one
+    string key = normalizeKey(query->getKey());
+    if (key.empty()) {
+        return;
+    }
+
+    auto& negatives = m_negatives[sourceId];
+    negatives.push_front({ key, toCategories(query), generation, Time::getCurrentTime() });
+    if (negatives.size() > MAX_NEGATIVES) {
+        negatives.pop_back();
+    }
+}
+
+void SearchManager::getStatus(JValue& status)
+{
+    JValue cache = Object();
+    m_cache.getStatus(cache);
+    status.put("cache", cache);
+}
+
+/**
+ * FTS and DB8 (collate primary) don't care cases and repeated spaces
+ */
+string SearchManager::normalizeKey(const string& searchKey)
+{
+    string key;
+    for (char c : searchKey) {
+        if (isspace(static_cast<unsigned char>(c))) {
+            if (!key.empty() && key.back() != ' ') {
+                key += ' ';
+            }
+        } else {
+            key += tolower(static_cast<unsigned char>(c));
+        }
+    }
+    if (!key.empty() && key.back() == ' ') {
+        key.pop_back();
+    }
+    return key;
+}
+
+/**
+ * Conditions giving different results except the key and paging:
+ * UI language, category generation, categories and maxItems.
+ */
+string SearchManager::toConditions(SearchQueryPtr request)
+{
+    string conditions = SettingService::getInstance()->language();
+    conditions += '\n' + to_string(Database::getInstance()->getCategoryGeneration());
+    conditions += '\n' + to_string(request->getMaxItems());
+    for (auto& cateId : request->getCategories()) {
+        conditions += '\n' + cateId;
+    }
+    return conditions;
+}
+
+string SearchManager::toCacheKey(SearchQueryPtr request)
+{
+    string cacheKey = normalizeKey(request->getKey()) + '\n' + toConditions(request);
+    cacheKey += '\n' + to_string(request->getLimit()) + ',' + to_string(request->getOffset());
+    for (auto& it : request->getCursors()) {
+        cacheKey += '\n' + it.first + '=' + it.second;
+    }
+    return cacheKey;
+}
+
+SearchCache::Generations SearchManager::getGenerations()
+{
+    SearchCache::Generations generations;
+    for (auto& it : m_searchSets) {
+        const string sourceId = it.second->getDataSource()->getId();
+        generations[sourceId] = getGeneration(sourceId);
+    }
+    return generations;
+}
+
+/**
+ * Cursors are given with the generation of the source when they're made ('generation:cursor').
+ * Scores and positions of items are changed by any write, the next page could skip or repeat items.
+ * Refined cursors are positions in the set kept by the session, it's expired when the set is gone.
+ */
+bool SearchManager::isExpired(SearchQueryPtr request)
+{
+    auto session = m_sessions.find(request->getSession());
+    for (auto& it : request->getCursors()) {
+        if (strtoul(it.second.c_str(), nullptr, 10) != getGeneration(it.first) || it.second.find(':') == string::npos) {
+            return true;
+        }
+
+        // positions are given by this service, others are opaque cursors of the source
+        int position = 0;
+        unsigned long serial = 0;
+        string cursor = getCursor(request, it.first);
+        if (!cursor.empty() && cursor[0] == '#' && !toPosition(cursor, position)) {
+            return true;
+        }
+        if (!toSerial(cursor, serial)) {
+            continue;
+        }
+        if (session == m_sessions.end() || session->second.serial != serial || session->second.conditions != toConditions(request)
+            || session->second.sources.find(it.first) == session->second.sources.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Position in a positional cursor ('#position' or '#position@serial'), false if it's not one or malformed.
+ */
+bool SearchManager::toPosition(const string& cursor, int& position)
+{
+    if (cursor.empty() || cursor[0] != '#') {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long value = strtol(cursor.c_str() + 1, &end, 10);
+    if (errno != 0 || end == cursor.c_str() + 1 || (*end != '\0' && *end != '@') || value < 0 || value > INT_MAX) {
+        return false;
+    }
+    position = (int)value;
+    return true;
+}
+
+/**
+ * Serial of the session in a refined cursor ('#position@serial'), false if it's not refined one.
+ */
+bool SearchManager::toSerial(const string& cursor, unsigned long& serial)
+{
+    size_t pos = cursor.find('@');
+    if (cursor.empty() || cursor[0] != '#' || pos == string::npos) {
+        return false;
+    }
+    serial = strtoul(cursor.c_str() + pos + 1, nullptr, 10);
+    return true;
+}
+
+string SearchManager::getCursor(SearchQueryPtr request, const string& sourceId)
+{
+    string cursor = request->getCursor(sourceId);
+    size_t pos = cursor.find(':');
+    return pos == string::npos ? "" : cursor.substr(pos + 1);
+}
+
+/**
+ * Increased whenever the source tells a change.
+ * Sources of v1 don't tell it, cached results of them are expired by TTL only.
+ */
+unsigned long SearchManager::getGeneration(const string& sourceId)
+{
+    auto it = m_generations.find(sourceId);
+    return it != m_generations.end() ? it->second : 0;
+}
+
+/**
+ * Search with the newest interface of the source, older ones give all items in one part
+ */
+bool SearchManager::searchSource(DataSourcePtr source, SearchQueryPtr query, SearchTokenPtr token, DataSourceV3::chunkCB callback)
+{
+    auto v3 = dynamic_pointer_cast<DataSourceV3>(source);
+    if (v3) {
+        return v3->searchChunks(std::move(query), std::move(token), std::move(callback));
+    }
+
+    auto all = [callback] (string sourceId, vector<SearchItemPtr> items) {
+        callback(sourceId, std::move(items), vector<string>(), true, false);
+    };
+    auto v2 = dynamic_pointer_cast<DataSourceV2>(source);
+    if (v2) {
+        return v2->search(std::move(query), std::move(token), std::move(all));
+    }
+    return source->search(query->getKey(), std::move(all));
+}
+
+SearchManager::SearchTask::SearchTask(SearchQueryPtr request, resultCB cb, const string& cacheKey, const SearchCache::Generations& generations)
+    : m_request(std::move(request))
     , m_callback(std::move(cb))
+    , m_cacheKey(cacheKey)
+    , m_generations(generations)
+    , m_token(make_shared<SearchToken>())
+    , m_serial(0)
+    , m_timer(0)
 {
-    Logger::debug("SearchManager", __FUNCTION__, Logger::format("Search task started: %s", key.c_str()));
+    Logger::debug("SearchManager", __FUNCTION__, Logger::format("Search task started: %s", m_request->getKey().c_str()));
 }
 
 SearchManager::SearchTask::~SearchTask()
 {
-    if (m_callback) {
-        m_callback(m_intents);
+    if (m_timer) {
+        g_source_remove(m_timer);
     }
+    finish();
     Logger::debug("SearchManager", __FUNCTION__, "Search task ended");
 }
 
-vector<IntentPtr>& SearchManager::SearchTask::get(const string &category)
+void SearchManager::SearchTask::setDeadline(int timeout)
+{
+    if (timeout <= 0) {
+        return;
+    }
+    m_token = make_shared<SearchToken>(timeout);
+
+    // the task can be ended before it
+    auto self = new weak_ptr<SearchTask>(shared_from_this());
+    m_timer = g_timeout_add_full(G_PRIORITY_DEFAULT, timeout, onDeadline, self, [] (gpointer data) {
+        delete static_cast<weak_ptr<SearchTask>*>(data);
+    });
+}
+
+gboolean SearchManager::SearchTask::onDeadline(gpointer data)
+{
+    auto task = static_cast<weak_ptr<SearchTask>*>(data)->lock();
+    if (task) {
+        task->m_timer = 0;
+        Logger::warning("SearchManager", __FUNCTION__, Logger::format("Timed out: %s (%zu source(s) not finished)", task->m_request->getKey().c_str(), task->m_pendings.size()));
+        task->finish();
+        task->m_token->cancel();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void SearchManager::SearchTask::finish()
+{
+    SearchManager::getInstance()->removeRunning(m_request->getSession(), this);
+    if (!m_callback) {
+        return;
+    }
+    // release callback (and what it holds) after this
+    resultCB callback = std::move(m_callback);
+    m_callback = nullptr;
+    m_progress = nullptr;
+    m_cancelled = nullptr;
+
+    // not finished sources are told as 'timedOut', their partial items (and cursors) are not given.
+    // next page searches them again from the cursors of the request
+    for (auto& it : m_results) {
+        auto& results = it.second;
+        results.erase(remove_if(results.begin(), results.end(), [this] (const Result& result) {
+            return m_pendings.find(result.sourceId) != m_pendings.end();
+        }), results.end());
+    }
+
+    SearchQueryPtr next;
+    auto intents = page(next);
+    vector<string> timedOut(m_pendings.begin(), m_pendings.end());
+
+    // partial results shouldn't be given again, nor refined ones (the session can be replaced)
+    bool refined = next && any_of(next->getCursors().begin(), next->getCursors().end(), [&next] (const pair<const string, string>& cursor) {
+        unsigned long serial = 0;
+        return SearchManager::toSerial(SearchManager::getCursor(next, cursor.first), serial);
+    });
+    if (timedOut.empty() && m_faileds.empty() && !refined) {
+        // with generations when it's started, it's invalid if sources are changed while searching
+        SearchManager::getInstance()->m_cache.put(m_cacheKey, m_generations, intents, next);
+    }
+
+    // keep all matched items of the complete sources, to refine them for the next key
+    if (!m_request->getSession().empty()) {
+        Session session;
+        session.key = normalizeKey(m_request->getKey());
+        session.conditions = toConditions(m_request);
+        session.generations = m_generations;
+        session.serial = m_serial;
+        for (auto& sourceId : m_completes) {
+            session.sources[sourceId] = std::move(m_sourceItems[sourceId]);
+        }
+        SearchManager::getInstance()->saveSession(m_request->getSession(), std::move(session));
+    }
+    callback(std::move(intents), std::move(next), std::move(timedOut));
+}
+
+void SearchManager::SearchTask::done(const string& sourceId)
+{
+    m_pendings.erase(sourceId);
+
+    // the last one is given by finish()
+    if (!m_progress || !m_callback || m_pendings.empty()) {
+        return;
+    }
+    SearchQueryPtr next;
+    m_progress(sourceId, page(next));
+}
+
+void SearchManager::SearchTask::cancel()
+{
+    if (!m_callback) {
+        return;
+    }
+    m_callback = nullptr;
+    m_progress = nullptr;
+    cancelCB cancelled = std::move(m_cancelled);
+    m_cancelled = nullptr;
+
+    // results of them are dropped as late ones
+    Logger::info("SearchManager", __FUNCTION__, Logger::format("Cancelled: %s (%zu source(s) cancelled)", m_request->getKey().c_str(), m_pendings.size()));
+    m_token->cancel();
+
+    if (cancelled) {
+        cancelled();
+    }
+}
+
+void SearchManager::SearchTask::add(const string& sourceId, SearchItemPtr item, IntentPtr intent, const string& cursor, bool visible)
+{
+    if (visible) {
+        m_results[item->getCategory()].push_back({sourceId, cursor, intent});
+    }
+    m_sourceItems[sourceId].push_back({std::move(item), std::move(intent)});
+}
+
+/**
+ * Cut a page from merged results in category rank order (offset, limit).
+ *
+ * 'next' has cursors of each source after the page, or null if no more.
+ */
+map<string, vector<IntentPtr>> SearchManager::SearchTask::page(SearchQueryPtr& next)
 {
-    if (m_intents.find(category) == m_intents.end()) {
-        m_intents.insert({category, vector<IntentPtr>()});
+    map<string, vector<IntentPtr>> intents;
+
+    auto nextQuery = make_shared<SearchQuery>(m_request->getKey());
+    for (auto& cateId : m_request->getCategories()) {
+        nextQuery->addCategory(cateId);
+    }
+    nextQuery->setLimit(m_request->getLimit());
+    nextQuery->setMaxItems(m_request->getMaxItems());
+    for (auto& it : m_request->getCursors()) {
+        nextQuery->setCursor(it.first, it.second);
     }
 
-    return m_intents[category];
+    int skip = m_request->getOffset();
+    int remains = (m_request->getLimit() > 0) ? m_request->getLimit() : INT_MAX;
+    bool hasMore = false;
+    for (auto& category : Database::getInstance()->getCategories()) {
+        auto it = m_results.find(category->getCategoryId());
+        if (it == m_results.end()) {
+            continue;
+        }
+        for (auto& result : it->second) {
+            if (skip > 0) {
+                skip--;
+            } else if (remains > 0) {
+                remains--;
+                intents[it->first].push_back(result.intent);
+            } else {
+                hasMore = true;
+                break;
+            }
+            nextQuery->setCursor(result.sourceId, Logger::format("%lu:%s", m_generations[result.sourceId], result.cursor.c_str()));
+        }
+        if (hasMore) {
+            break;
+        }
+    }
+
+    if (hasMore) {
+        next = std::move(nextQuery);
+    }
+    return intents;
 }
 
 void SearchManager::loadPlugins()
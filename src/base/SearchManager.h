@@ -17,13 +17,17 @@
 #ifndef BASE_SEARCHMANAGER_H_
 #define BASE_SEARCHMANAGER_H_
 
+#include <list>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
+#include <glib.h>
 #include <sqlite3.h>
 #include <pbnjson.hpp>
 
 #include "SearchSet.h"
+#include "base/SearchCache.h"
 #include "Intent.h"
 #include "SearchItem.h"
 
@@ -48,32 +52,137 @@ public:
     SearchSetPtr findSearchSet(const string& id);
     CategoryPtr findCategory(const string& id);
 
-    using resultCB = function<void(map<string, vector<IntentPtr>>)>;
-    bool search(const string& searchKey, resultCB cb);
+    // 'next' is the query for the next page, null if no more
+    // 'timedOut' is ids of sources not finished until the deadline
+    using resultCB = function<void(map<string, vector<IntentPtr>>, SearchQueryPtr next, vector<string> timedOut)>;
+    // the page of results so far, whenever a source is finished before others
+    using progressCB = function<void(const string& sourceId, map<string, vector<IntentPtr>>)>;
+    // a newer search of the same session is started, instead of the result
+    using cancelCB = function<void()>;
+    // search on categories of the query (none = all enabled ones), within its limits and cursors
+    bool search(SearchQueryPtr request, resultCB cb, progressCB progress = nullptr, cancelCB cancelled = nullptr);
+    // the client doesn't wait the result anymore, stop it without any result
+    void cancel(SearchQueryPtr request);
+
+    // sources are changed after the cursors of the request are given, search again from the first page
+    bool isExpired(SearchQueryPtr request);
+
+    // status of the result cache
+    void getStatus(JValue& status);
 
     void categoryAdded(CategoryPtr category) override;
     void categoryRemoved(const string& cateId) override;
 
 private:
-    SearchManager() {}
+    SearchManager() : m_serial(0) {}
 
     void loadPlugins();
 
-    class SearchTask {
+    static string normalizeKey(const string& key);
+    static string toConditions(SearchQueryPtr request);
+    static string toCacheKey(SearchQueryPtr request);
+    SearchCache::Generations getGenerations();
+    unsigned long getGeneration(const string& sourceId);
+    static string getCursor(SearchQueryPtr request, const string& sourceId);
+    static bool searchSource(DataSourcePtr source, SearchQueryPtr query, SearchTokenPtr token, DataSourceV3::chunkCB callback);
+
+    class SearchTask : public enable_shared_from_this<SearchTask> {
     public:
-        SearchTask(const string& key, resultCB cb);
+        SearchTask(SearchQueryPtr request, resultCB cb, const string& cacheKey, const SearchCache::Generations& generations);
         ~SearchTask();
 
-        vector<IntentPtr>& get(const string &category);
+        // respond with finished sources when it's expired (and cancel others)
+        void setDeadline(int timeout);
+        // given to sources, cancelled when the result isn't needed
+        SearchQueryPtr getRequest() { return m_request; }
+        SearchTokenPtr getToken() { return m_token; }
+        void setProgress(progressCB progress) { m_progress = std::move(progress); }
+        void setCancelled(cancelCB cancelled) { m_cancelled = std::move(cancelled); }
+        void start(const string& sourceId) { m_pendings.insert(sourceId); }
+        void done(const string& sourceId);
+        bool isFinished() { return !m_callback; }
+        // superseded, stop running sources without any result
+        void cancel();
+
+        // not visible one is kept only for the session
+        void add(const string& sourceId, SearchItemPtr item, IntentPtr intent, const string& cursor, bool visible = true);
+        // the source gave all matched items
+        void setComplete(const string& sourceId) { m_completes.insert(sourceId); }
+        // the source couldn't search all (e.g. service error), the result isn't cached
+        void setFailed(const string& sourceId) { m_faileds.insert(sourceId); }
+        // identifies the session saved by this task, refined cursors are valid only on it
+        void setSerial(unsigned long serial) { m_serial = serial; }
+        unsigned long getSerial() { return m_serial; }
 
     private:
-        string m_key;
+        struct Result {
+            string sourceId;
+            string cursor;
+            IntentPtr intent;
+        };
+
+        static gboolean onDeadline(gpointer data);
+
+        void finish();
+        map<string, vector<IntentPtr>> page(SearchQueryPtr& next);
+
+        SearchQueryPtr m_request;
         resultCB m_callback;
-        map<string, vector<IntentPtr>> m_intents;
+        progressCB m_progress;
+        cancelCB m_cancelled;
+        string m_cacheKey;
+        SearchCache::Generations m_generations;
+        map<string, vector<Result>> m_results;
+        map<string, vector<pair<SearchItemPtr, IntentPtr>>> m_sourceItems;
+        set<string> m_completes;
+        set<string> m_faileds;
+        set<string> m_pendings;
+        SearchTokenPtr m_token;
+        unsigned long m_serial;
+        guint m_timer;
     };
 
+    // results of previous search, of each session
+    struct Session {
+        string key;
+        string conditions;
+        SearchCache::Generations generations;
+        // serial of the task saved it
+        unsigned long serial;
+        // only sources gave all matched items (not cut by limits)
+        map<string, vector<pair<SearchItemPtr, IntentPtr>>> sources;
+        double used;
+    };
+
+    static bool toPosition(const string& cursor, int& position);
+    static bool toSerial(const string& cursor, unsigned long& serial);
+    bool refine(Session& session, DataSourcePtr source, SearchQueryPtr request, shared_ptr<SearchTask> task);
+    void saveSession(const string& id, Session session);
+    void removeRunning(const string& sessionId, SearchTask* task);
+
+    // keys found nothing on a source, keys extending them can't find anything either
+    struct Negative {
+        string key;
+        string categories;
+        unsigned long generation;
+        double created;
+    };
+
+    static string toCategories(SearchQueryPtr query);
+    bool isNegative(DataSourcePtr source, SearchQueryPtr query);
+    void addNegative(const string& sourceId, unsigned long generation, SearchQueryPtr query);
+
     map<string, SearchSetPtr> m_searchSets;
     vector<void*> m_pluginHandles;
+    SearchCache m_cache;
+    map<string, Session> m_sessions;
+    map<string, list<Negative>> m_negatives;
+    // source id => generation, increased when the source is changed
+    map<string, unsigned long> m_generations;
+    // running search of each session
+    map<string, weak_ptr<SearchTask>> m_runnings;
+    // the last serial given to tasks
+    unsigned long m_serial;
 };
 
 #endif /* BASE_DATABASE_H_ */
@@ -16,6 +16,9 @@
 
 #include "SAM.h"
 
+#include <algorithm>
+#include <set>
+
 #include "base/Database.h"
 #include "base/SearchManager.h"
 #include "util/File.h"
@@ -76,44 +79,62 @@ bool SAM::onListApps(LSHandle* sh, LSMessage* message, void* context)
     JValue apps = Object();
     string change;
     if (JValueUtil::getValue(subscriptionPayload, "apps", apps) && apps.isArray()) {
-        // when app list comes, remove first
-        appInst->removeFromDatabase();
+        // when app list comes, apply only changed ones (e.g. resubscription, locale change)
+        appInst->syncToDatabase(apps);
 
         int countAdd = 0, countUpdate = 0;
+        set<string> appIds;
         for (auto lp : apps.items()) {
-            // add applications
-            if (appInst->addToDatabase(lp)) {
-                countAdd++;
-            }
-
             // create or update appContent (don't recreate because it's to heavy)
             string id, title;
             JValueUtil::getValue(lp, "id", id);
             JValueUtil::getValue(lp, "title", title);
+            appIds.insert(id);
             auto category = sam->m_searchSet->findCategory(id);
             if (category) {
-                category->setCategoryName(title);
-                Database::getInstance()->updateCategory(std::move(category));
-                countUpdate++;
+                if (category->getCategoryName() != title) {
+                    category->setCategoryName(title);
+                    Database::getInstance()->updateCategory(std::move(category));
+                    countUpdate++;
+                }
             } else {
                 if (sam->addAppContents(lp)) {
                     countAdd++;
                 }
             }
         }
-        Logger::info(getClassName(), __FUNCTION__, Logger::format("Added: %d, Updated: %d", countAdd, countUpdate));
+
+        // remove indexes of the apps uninstalled while this service is not running
+        vector<string> staleIds;
+        for (auto& it : Database::getInstance()->getFingerprints()) {
+            if (appIds.find(it.first) == appIds.end()) {
+                staleIds.push_back(it.first);
+            }
+        }
+        for (auto& id : staleIds) {
+            Database::getInstance()->removeCategory(id);
+        }
+        Logger::info(getClassName(), __FUNCTION__, Logger::format("AppContents Added: %d, Updated: %d, Removed: %zu", countAdd, countUpdate, staleIds.size()));
     } else if (JValueUtil::getValue(subscriptionPayload, "change", change)) {
         // Second~ (changed)
         JValue app = Object();
         if (JValueUtil::getValue(subscriptionPayload, "app", app)) {
             if (change == "added") {
+                // cancel pending removal of same app (e.g. reinstalled)
+                string id;
+                JValueUtil::getValue(app, "id", id);
+                auto removed = find(sam->m_removedApps.begin(), sam->m_removedApps.end(), id);
+                if (removed != sam->m_removedApps.end()) {
+                    sam->m_removedApps.erase(removed);
+                }
                 appInst->addToDatabase(app);
-                sam->addAppContents(app);
+                // index newly installed app prior to the others
+                sam->addAppContents(app, IndexPriority_HIGH);
                 Logger::info(getClassName(), __FUNCTION__, "Add a item");
             } else if (change == "removed") {
                 string id;
                 JValueUtil::getValue(app, "id", id);
-                appInst->removeFromDatabase(id);
+                sam->removeApp(id);
                 sam->m_searchSet->removeCategory(id);
                 Logger::info(getClassName(), __FUNCTION__, "Remove a item");
             }
@@ -123,7 +144,7 @@ bool SAM::onListApps(LSHandle* sh, LSMessage* message, void* context)
     return true;
 }
 
-bool SAM::addAppContents(JValue &app)
+bool SAM::addAppContents(JValue &app, IndexPriority priority)
 {
     string searchIndex, type, id, title;
 
@@ -138,7 +159,7 @@ bool SAM::addAppContents(JValue &app)
             return false;
         }
 
-        auto appContent = make_shared<AppContents>(id, title, app);
+        auto appContent = make_shared<AppContents>(id, title, app, priority);
         m_searchSet->addCategory(appContent);
         return true;
     }
@@ -146,6 +167,21 @@ bool SAM::addAppContents(JValue &app)
     return false;
 }
 
+void SAM::removeApp(const string& id)
+{
+    // removals come one by one (e.g. uninstalling many apps), delete them at once on idle
+    if (m_removedApps.empty()) {
+        g_idle_add([] (gpointer data) -> gboolean {
+            SAM* sam = static_cast<SAM*>(data);
+            sam->m_applications->removeFromDatabase(sam->m_removedApps);
+            Logger::info(getClassName(), __FUNCTION__, Logger::format("Removed: %zu", sam->m_removedApps.size()));
+            sam->m_removedApps.clear();
+            return G_SOURCE_REMOVE;
+        }, this);
+    }
+    m_removedApps.push_back(id);
+}
+
 bool SAM::reloadAppsByLocaleChange()
 {
     if (!isConnected()) {
@@ -56,12 +56,14 @@ private:
 
     SAM();
 
-    bool addAppContents(JValue &app);
+    bool addAppContents(JValue &app, IndexPriority priority = IndexPriority_NORMAL);
+    void removeApp(const string& id);
 
     Call m_listAppsCall;
 
     SearchSetPtr m_searchSet;
     ApplicationsPtr m_applications;
+    vector<string> m_removedApps;
 };
 
 #endif  // BUS_CLIENT_SAM_H_
@@ -17,6 +17,7 @@
 #include "bus/service/UnifiedSearch.h"
 #include "LunaClient.h"
 
+#include <glib.h>
 #include <string>
 #include <vector>
 #include <thread>
@@ -34,6 +35,7 @@ UnifiedSearch::UnifiedSearch()
         LS_CATEGORY_METHOD(search)
         LS_CATEGORY_METHOD(getCategories)
         LS_CATEGORY_METHOD(updateCategory)
+        LS_CATEGORY_METHOD(getStatus)
     LS_CATEGORY_END
 }
 
@@ -46,6 +48,11 @@ bool UnifiedSearch::onInitialization()
     try {
         Handle::attachToLoop(m_mainloop);
         LunaClient::setMainHandle(this);
+
+        LSErrorSafe error;
+        if (!LSSubscriptionSetCancelFunction(get(), onSubscriptionCancel, this, &error)) {
+            Logger::warning(getClassName(), __FUNCTION__, Logger::format("Failed to set cancel function: %s", error.message));
+        }
     } catch(exception& e) {
     }
     return true;
@@ -62,67 +69,326 @@ bool UnifiedSearch::search(LSMessage &message)
     const auto& requestPayload = task->requestPayload();
     auto responsePayload = task->responsePayload();
 
-    string key;
-    if (!JValueUtil::getValue(requestPayload, "key", key)) {
-        responsePayload.put("errorCode", 101);
-        responsePayload.put("errorText", "The 'key' isn't specified.");
+    // continue the previous search, the token has all conditions of it
+    SearchQueryPtr query;
+    string next;
+    unsigned long categoryGeneration = Database::getInstance()->getCategoryGeneration();
+    if (JValueUtil::getValue(requestPayload, "next", next)) {
+        query = fromToken(next, categoryGeneration);
+        if (!query) {
+            responsePayload.put("errorCode", 107);
+            responsePayload.put("errorText", "The 'next' is invalid.");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+    } else {
+        string key;
+        if (!JValueUtil::getValue(requestPayload, "key", key)) {
+            responsePayload.put("errorCode", 101);
+            responsePayload.put("errorText", "The 'key' isn't specified.");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+
+        if (key.empty() || key.size() < 2) {
+            responsePayload.put("errorCode", 102);
+            responsePayload.put("errorText", "The 'key' is empty or too short. (needs >= 2 bytes)");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+
+        // optional, search only on given categories
+        query = make_shared<SearchQuery>(key);
+        if (requestPayload.hasKey("categories")) {
+            JValue cateArr = requestPayload["categories"];
+            bool valid = cateArr.isArray() && cateArr.arraySize() > 0;
+            for (int i = 0; valid && i < cateArr.arraySize(); i++) {
+                valid = cateArr[i].isString();
+                if (valid) {
+                    query->addCategory(cateArr[i].asString());
+                }
+            }
+            if (!valid) {
+                responsePayload.put("errorCode", 103);
+                responsePayload.put("errorText", "The 'categories' should be a non-empty array of category ids.");
+                responsePayload.put("returnValue", false);
+                return false;
+            }
+        }
+
+        // optional, the number of items in total and per category
+        int limit = 0, maxItems = 0;
+        if (requestPayload.hasKey("limit") && (!JValueUtil::getValue(requestPayload, "limit", limit) || limit < 1)) {
+            responsePayload.put("errorCode", 104);
+            responsePayload.put("errorText", "The 'limit' should be a positive number.");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+        if (requestPayload.hasKey("maxItems") && (!JValueUtil::getValue(requestPayload, "maxItems", maxItems) || maxItems < 1)) {
+            responsePayload.put("errorCode", 105);
+            responsePayload.put("errorText", "The 'maxItems' should be a positive number.");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+        query->setLimit(limit);
+        query->setMaxItems(maxItems);
+
+        // optional, the number of items to skip
+        int offset = 0;
+        if (requestPayload.hasKey("offset") && (!JValueUtil::getValue(requestPayload, "offset", offset) || offset < 0)) {
+            responsePayload.put("errorCode", 106);
+            responsePayload.put("errorText", "The 'offset' should be zero or a positive number.");
+            responsePayload.put("returnValue", false);
+            return false;
+        }
+        query->setOffset(offset);
+    }
+
+    // optional, milliseconds to wait slow sources
+    int timeout = 0;
+    if (requestPayload.hasKey("timeoutMs") && (!JValueUtil::getValue(requestPayload, "timeoutMs", timeout) || timeout < 1)) {
+        responsePayload.put("errorCode", 108);
+        responsePayload.put("errorText", "The 'timeoutMs' should be a positive number.");
         responsePayload.put("returnValue", false);
         return false;
     }
+    query->setTimeout(timeout);
+
+    // each client types its own keys
+    Message& request = task->request();
+    const char* sender = request.getSenderServiceName() ? request.getSenderServiceName() : request.getApplicationID();
+    if (sender) {
+        query->setSession(sender);
+    }
 
-    if (key.empty() || key.size() < 2) {
-        responsePayload.put("errorCode", 102);
-        responsePayload.put("errorText", "The 'key' is empty or too short. (needs >= 2 bytes)");
+    // refined items of the token are kept by the session of the sender.
+    // items are paged in category rank order, it's changed by any change of categories
+    bool expired = categoryGeneration != Database::getInstance()->getCategoryGeneration();
+    if (!next.empty() && (expired || SearchManager::getInstance()->isExpired(query))) {
+        responsePayload.put("errorCode", 110);
+        responsePayload.put("errorText", "The 'next' is expired, items are changed. Search again without it.");
         responsePayload.put("returnValue", false);
         return false;
     }
 
+    // optional, reply results of each source as soon as it's finished
+    bool subscribe = false;
+    JValueUtil::getValue(requestPayload, "subscribe", subscribe);
+    string subscription;
+    if (subscribe && LSMessageIsSubscription(&message)) {
+        LSErrorSafe error;
+        string key = Logger::format("search/%lu", (unsigned long) LSMessageGetUniqueToken(&message));
+        if (LSSubscriptionAdd(get(), key.c_str(), &message, &error)) {
+            subscription = key;
+        } else {
+            Logger::warning(getClassName(), __FUNCTION__, Logger::format("Failed to add subscription: %s", error.message));
+        }
+    }
+    SearchManager::progressCB progress;
+    if (!subscription.empty()) {
+        m_subscriptions[subscription] = query;
+        responsePayload.put("subscribed", true);
+        responsePayload.put("done", true);
+        progress = [task] (const string& sourceId, map<string, vector<IntentPtr>> allIntents) {
+            JValue reply = Object();
+            reply.put("subscribed", true);
+            reply.put("done", false);
+            reply.put("sourceId", sourceId);
+            reply.put("results", toResults(allIntents));
+            reply.put("returnValue", true);
+            task->reply(reply);
+        };
+    }
+
     // add results array
     responsePayload.put("results", Array());
 
     // search from SearchManager
-    auto allIntents = SearchManager::getInstance()->search(key, [this, task] (map<string, vector<IntentPtr>> allIntents) {
-        // to append results with category ranking
-        auto categories = Database::getInstance()->getCategories();
-        for (auto category : categories) {
-            if (category->isEnabled()) {
-                const string& cateId = category->getCategoryId();
-                auto it = allIntents.find(cateId);
-                // if no item allIntents doesn't have it's category. just continue
-                if (it == allIntents.end()) {
-                    continue;
-                }
-                auto intents = it->second;
-
-                // create json array
-                JValue intentArr = Array();
-                for (auto intent : intents) {
-                    JValue obj;
-                    intent->toJson(obj);
-                    intentArr.append(obj);
-                }
+    SearchManager::getInstance()->search(query, [this, task, categoryGeneration, subscription] (map<string, vector<IntentPtr>> allIntents, SearchQueryPtr next, vector<string> timedOut) {
+        // the last reply ends the subscription
+        unsubscribe(subscription);
+        task->responsePayload().put("results", toResults(allIntents));
 
-                // create object and append
-                JValue cateObj = Object();
-                cateObj.put("categoryId", cateId);
-                cateObj.put("items", intentArr);
-                task->responsePayload()["results"].append(cateObj);
+        // more items exist, give the token to get them
+        if (next) {
+            task->responsePayload().put("next", toToken(next, categoryGeneration));
+        }
+
+        // partial results, these sources are not included
+        if (!timedOut.empty()) {
+            JValue sources = Array();
+            for (auto& sourceId : timedOut) {
+                sources.append(sourceId);
             }
+            task->responsePayload().put("timedOut", sources);
         }
+    }, std::move(progress), [this, task, subscription] () {
+        // the same client searches another key
+        unsubscribe(subscription);
+        task->responsePayload().remove("results");
+        task->responsePayload().put("errorCode", 109);
+        task->responsePayload().put("errorText", "Superseded by a newer search.");
+        task->responsePayload().put("returnValue", false);
     });
 
     responsePayload.put("returnValue", true);
     return true;
 }
 
+/**
+ * The client cancelled the subscription (or it's gone), its search isn't needed anymore
+ */
+bool UnifiedSearch::onSubscriptionCancel(LSHandle *sh, LSMessage *message, void *ctx)
+{
+    UnifiedSearch* self = static_cast<UnifiedSearch*>(ctx);
+    string key = Logger::format("search/%lu", (unsigned long) LSMessageGetUniqueToken(message));
+    auto it = self->m_subscriptions.find(key);
+    if (it == self->m_subscriptions.end()) {
+        return true;
+    }
+
+    // removed by luna-service itself
+    SearchQueryPtr query = std::move(it->second);
+    self->m_subscriptions.erase(it);
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Subscription cancelled: %s", key.c_str()));
+    SearchManager::getInstance()->cancel(query);
+    return true;
+}
+
+void UnifiedSearch::unsubscribe(const string& key)
+{
+    if (m_subscriptions.erase(key) == 0) {
+        return;
+    }
+
+    LSErrorSafe error;
+    LSSubscriptionIter *iter = nullptr;
+    if (!LSSubscriptionAcquire(get(), key.c_str(), &iter, &error)) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("Failed to remove subscription: %s", error.message));
+        return;
+    }
+    while (LSSubscriptionHasNext(iter)) {
+        LSSubscriptionNext(iter);
+        LSSubscriptionRemove(iter);
+    }
+    LSSubscriptionRelease(iter);
+}
+
+/**
+ * Results array of categories (with their items) in category rank order
+ */
+JValue UnifiedSearch::toResults(const map<string, vector<IntentPtr>>& allIntents)
+{
+    JValue results = Array();
+    const auto& categories = Database::getInstance()->getCategories();
+    for (auto& category : categories) {
+        if (category->isEnabled()) {
+            const string& cateId = category->getCategoryId();
+            auto it = allIntents.find(cateId);
+            // if no item allIntents doesn't have it's category. just continue
+            if (it == allIntents.end()) {
+                continue;
+            }
+            const auto& intents = it->second;
+
+            // create json array
+            JValue intentArr = Array();
+            for (auto intent : intents) {
+                JValue obj;
+                intent->toJson(obj);
+                intentArr.append(obj);
+            }
+
+            // create object and append
+            JValue cateObj = Object();
+            cateObj.put("categoryId", cateId);
+            cateObj.put("items", intentArr);
+            results.append(cateObj);
+        }
+    }
+    return results;
+}
+
+/**
+ * Continuation token, base64 of the query (key, conditions and cursors) in JSON
+ */
+string UnifiedSearch::toToken(SearchQueryPtr query, unsigned long categoryGeneration)
+{
+    JValue json = Object();
+    json.put("key", query->getKey());
+    JValue categories = Array();
+    for (auto& cateId : query->getCategories()) {
+        categories.append(cateId);
+    }
+    json.put("categories", categories);
+    json.put("limit", query->getLimit());
+    json.put("maxItems", query->getMaxItems());
+    JValue cursors = Object();
+    for (auto& it : query->getCursors()) {
+        cursors.put(it.first, it.second);
+    }
+    json.put("cursors", cursors);
+    json.put("categoryGeneration", to_string(categoryGeneration));
+
+    string str = json.stringify();
+    gchar* encoded = g_base64_encode(reinterpret_cast<const guchar*>(str.c_str()), str.size());
+    string token = encoded;
+    g_free(encoded);
+    return token;
+}
+
+SearchQueryPtr UnifiedSearch::fromToken(const string& token, unsigned long& categoryGeneration)
+{
+    gsize size = 0;
+    guchar* decoded = g_base64_decode(token.c_str(), &size);
+    string str(reinterpret_cast<const char*>(decoded), size);
+    g_free(decoded);
+
+    JValue json = JDomParser::fromString(str);
+    // same checks as the request, the token can be made by anyone
+    string key, generation;
+    JValue categories, cursors;
+    int limit = 0, maxItems = 0;
+    bool valid = json.isObject() && JValueUtil::getValue(json, "key", key) && key.size() >= 2;
+    valid = valid && JValueUtil::getValue(json, "categories", categories) && categories.isArray();
+    valid = valid && JValueUtil::getValue(json, "cursors", cursors) && cursors.isObject();
+    valid = valid && JValueUtil::getValue(json, "categoryGeneration", generation) && !generation.empty();
+    valid = valid && (!json.hasKey("limit") || (JValueUtil::getValue(json, "limit", limit) && limit >= 0));
+    valid = valid && (!json.hasKey("maxItems") || (JValueUtil::getValue(json, "maxItems", maxItems) && maxItems >= 0));
+    for (int i = 0; valid && i < categories.arraySize(); i++) {
+        valid = categories[i].isString();
+    }
+    if (valid) {
+        for (auto cursor : cursors.children()) {
+            valid = valid && cursor.second.isString();
+        }
+    }
+    if (!valid) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("Invalid token: %s", token.c_str()));
+        return nullptr;
+    }
+    categoryGeneration = strtoul(generation.c_str(), nullptr, 10);
+
+    auto query = make_shared<SearchQuery>(key);
+    for (auto cateObj : categories.items()) {
+        query->addCategory(cateObj.asString());
+    }
+    query->setLimit(limit);
+    query->setMaxItems(maxItems);
+    for (auto cursor : cursors.children()) {
+        query->setCursor(cursor.first.asString(), cursor.second.asString());
+    }
+    return query;
+}
+
 bool UnifiedSearch::getCategories(LSMessage &message)
 {
     auto task = make_shared<LunaResTask>(getClassName(), __FUNCTION__, &message);
     auto responsePayload = task->responsePayload();
-    auto categories = Database::getInstance()->getCategories();
+    const auto& categories = Database::getInstance()->getCategories();
     JValue cateEnabled = Array();
     JValue cateDisabled = Array();
-    for (auto category : categories) {
+    for (auto& category : categories) {
         JValue cateObj = Object();
         cateObj.put("id", category->getCategoryId());
         cateObj.put("name", category->getCategoryName());
@@ -184,7 +450,7 @@ bool UnifiedSearch::updateCategory(LSMessage &message)
         return false;
     }
 
-    // apply enabled (For now, the rank is only for getCategories from sqlite3, directly)
+    // apply enabled (For now, the rank is only for getCategories from Database, directly)
     auto org = SearchManager::getInstance()->findCategory(id);
     if(org == NULL) return false;
     org->setEnabled(enabled);
@@ -193,6 +459,18 @@ bool UnifiedSearch::updateCategory(LSMessage &message)
     return true;
 }
 
+bool UnifiedSearch::getStatus(LSMessage &message)
+{
+    auto task = make_shared<LunaResTask>(getClassName(), __FUNCTION__, &message);
+    auto responsePayload = task->responsePayload();
+    SearchManager::getInstance()->getStatus(responsePayload);
+    JValue database = Object();
+    Database::getInstance()->getStatus(database);
+    responsePayload.put("database", database);
+    responsePayload.put("returnValue", true);
+    return true;
+}
+
 UnifiedSearch::LunaResTask::LunaResTask(const string& className, const string& funcName, LSMessage *msg)
     : m_className(className)
     , m_funcName(funcName)
@@ -208,9 +486,13 @@ UnifiedSearch::LunaResTask::~LunaResTask() {
 }
 
 void UnifiedSearch::LunaResTask::respond() {
+    reply(m_response);
+}
+
+void UnifiedSearch::LunaResTask::reply(JValue payload) {
     try {
-        m_message.respond(m_response.stringify().c_str());
-        Logger::logCallResponse(m_className, m_funcName, m_message, m_response);
+        m_message.respond(payload.stringify().c_str());
+        Logger::logCallResponse(m_className, m_funcName, m_message, payload);
     } catch(exception& e) {
         Logger::error(m_className, m_funcName, Logger::format("LunaResTask::respond exception: %s\n", e.what()));
     }
@@ -22,6 +22,9 @@
 #include <pbnjson.hpp>
 #include <luna-service2/lunaservice.hpp>
 
+#include "Intent.h"
+#include "SearchQuery.h"
+
 #include "interface/IInitializable.h"
 #include "interface/ISingleton.h"
 
@@ -54,6 +57,8 @@ private:
 
         // generally, called on last callback executed automatically
         void respond();
+        // one more reply before the last one, for subscription
+        void reply(JValue payload);
 
     private:
         string m_className;
@@ -63,9 +68,21 @@ private:
         JValue m_response;
     };
 
+    // cancelled by the client (or it's gone), the search isn't needed anymore
+    static bool onSubscriptionCancel(LSHandle *sh, LSMessage *message, void *ctx);
+    void unsubscribe(const string& key);
+
+    static JValue toResults(const map<string, vector<IntentPtr>>& allIntents);
+    static string toToken(SearchQueryPtr query, unsigned long categoryGeneration);
+    static SearchQueryPtr fromToken(const string& token, unsigned long& categoryGeneration);
+
     bool search(LSMessage &message);
     bool getCategories(LSMessage &message);
     bool updateCategory(LSMessage &message);
+    bool getStatus(LSMessage &message);
+
+    // subscription key => query of the running search
+    map<string, SearchQueryPtr> m_subscriptions;
 };
 
 #endif
@@ -17,32 +17,74 @@
 #include "AppContents.h"
 
 #include "base/Database.h"
+#include "base/Indexer.h"
 #include "base/SearchManager.h"
 #include "bus/client/SettingService.h"
 #include "util/File.h"
 #include "util/JValueUtil.h"
 
-AppContents::AppContents(string id, string name, JValue &app)
+static const string MANIFEST_FILE_NAME = "ilibmanifest.json";
+
+AppContents::AppContents(string id, string name, JValue &app, IndexPriority priority)
     : Category(id, name)
-    , m_appInfo(app)
 {
-    // FIXME - no need to re-index installted app
-    eraseCategory();
+    // parsing is done on the indexer thread, it shouldn't share JValue with main thread
+    JValue appInfo = app.duplicate();
+    string categoryId = getCategoryId();
+    string oldFingerprint = Database::getInstance()->getFingerprint(categoryId);
+    auto fingerprint = make_shared<string>();
+
+    auto parse = [appInfo, categoryId, oldFingerprint, fingerprint] () mutable -> vector<SearchItemPtr> {
+        // no need to re-index when the app and its resources are not changed
+        *fingerprint = getFingerprint(appInfo);
+        if (*fingerprint == oldFingerprint) {
+            Logger::info(getClassName(), __FUNCTION__, Logger::format("Not changed, reuse indexes: %s", categoryId.c_str()));
+            fingerprint->clear();
+            return vector<SearchItemPtr>();
+        }
+        return createIndexes(categoryId, appInfo);
+    };
+
+    auto done = [categoryId, fingerprint] (vector<SearchItemPtr> items) {
+        if (fingerprint->empty()) {
+            return;
+        }
+
+        // forget old one first, to index again if it's interrupted
+        auto db = Database::getInstance();
+        db->removeFingerprint(categoryId);
+
+        // old items are searched until new ones are all in
+        size_t count = items.size();
+        db->replaceItems(categoryId, items, [categoryId, fingerprint, count] (bool success) {
+            if (!success) {
+                Logger::warning(getClassName(), "AppContents", Logger::format("Failed to add items : %s", categoryId.c_str()));
+                return;
+            }
+            if (count == 0) {
+                return;
+            }
+            Database::getInstance()->setFingerprint(categoryId, *fingerprint);
+            Logger::info(getClassName(), "AppContents", Logger::format("Indexed %s : %zu added", categoryId.c_str(), count));
+        });
+    };
 
-    createIndexes();
+    Indexer::getInstance()->request(categoryId, priority, parse, done);
 }
 
 AppContents::~AppContents()
 {
 }
 
-bool AppContents::createIndexes()
+vector<SearchItemPtr> AppContents::createIndexes(const string& categoryId, JValue& appInfo)
 {
+    vector<SearchItemPtr> sItems;
+
     string id, searchIndex, folderPath, icon;
-    JValueUtil::getValue(m_appInfo, "id", id);
-    JValueUtil::getValue(m_appInfo, "folderPath", folderPath);
-    JValueUtil::getValue(m_appInfo, "searchIndex", searchIndex);
-    JValueUtil::getValue(m_appInfo, "icon", icon);
+    JValueUtil::getValue(appInfo, "id", id);
+    JValueUtil::getValue(appInfo, "folderPath", folderPath);
+    JValueUtil::getValue(appInfo, "searchIndex", searchIndex);
+    JValueUtil::getValue(appInfo, "icon", icon);
 
     string indexFilePath = File::join(folderPath, searchIndex);
     JValue indexJson = JDomParser::fromFile(indexFilePath.c_str());
@@ -50,27 +92,26 @@ bool AppContents::createIndexes()
 
     if (!indexJson.isValid()) {
         Logger::warning(getClassName(), __FUNCTION__, Logger::format("Index file is not exist or invalid format : %s", indexFilePath.c_str()));
-        return false;
+        return sItems;
     }
 
     JValue items;
     if (!JValueUtil::getValue(indexJson, "items", items) || !items.isArray()) {
         Logger::warning(getClassName(), __FUNCTION__, Logger::format("Index file doesn't have items : %s", indexFilePath.c_str()));
-        return false;
+        return sItems;
     }
 
     // get all labels
-    map<string, map<string, string>> allLabels = getLabels();
+    map<string, map<string, string>> allLabels = getLabels(appInfo);
     if (allLabels.empty()) {
         Logger::warning(getClassName(), __FUNCTION__, Logger::format("Failed to load labels : %s", id.c_str()));
-        return false;
+        return sItems;
     }
 
     JValue display = Object();
     display.put("icon", File::join(folderPath, icon));
 
     // per search item
-    int count = 0;
     for (auto item : items.items()) {
         string path;
         JValue labelKeys, titles, extra;
@@ -109,7 +150,6 @@ bool AppContents::createIndexes()
                 for (auto& label : labelLangs) {
                     titles.put(label.first, label.second);
                 }
-                display.put("title", titles);
             }
 
             // for all languages
@@ -127,18 +167,18 @@ bool AppContents::createIndexes()
             continue;
         }
 
+        // each item needs its own display, items are stored after parsing all
+        JValue itemDisplay = display.duplicate();
+        itemDisplay.put("title", titles);
+
         // generate key
         string key = string("app://") + id + path;
-        SearchItemPtr sItem = make_shared<SearchItem>(getCategoryId(), key, searchValue, display, extra);
-
-        // add to database
-        if (Database::getInstance()->insertItem(sItem)) {
-            count++;
-        }
+        sItems.push_back(make_shared<SearchItem>(categoryId, key, searchValue, itemDisplay, extra));
     }
-    Logger::info(getClassName(), __FUNCTION__, Logger::format("End parse %s : %d added", id.c_str(), count));
 
-    return true;
+    // stored at once on main loop
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("End parse %s : %zu parsed", id.c_str(), sItems.size()));
+    return sItems;
 }
 
 IntentPtr AppContents::generateIntent(SearchItemPtr item)
@@ -178,33 +218,23 @@ bool AppContents::eraseCategory()
  *  - second key = language (e.g. 'en', 'ko')
  *  - third value = label Value
  */
-map<string, map<string, string>> AppContents::getLabels()
+map<string, map<string, string>> AppContents::getLabels(JValue& appInfo)
 {
     string id, folderPath;
-    JValueUtil::getValue(m_appInfo, "id", id);
-    JValueUtil::getValue(m_appInfo, "folderPath", folderPath);
-
-    // open manifest and get label filenames
-    static const string manifestFileName = "ilibmanifest.json";
+    JValueUtil::getValue(appInfo, "id", id);
+    JValueUtil::getValue(appInfo, "folderPath", folderPath);
     string resourceFolder = File::join(folderPath, "resources");
-    string maniFilePath = File::join(resourceFolder, manifestFileName);
-
-    JValue manifest = JDomParser::fromFile(maniFilePath.c_str());
 
     map<string, map<string, string>> allLabels;
 
-    JValue labelFiles;
-    if (!JValueUtil::getValue(manifest, "files", labelFiles) || !labelFiles.isArray()) {
-        Logger::warning(getClassName(), __FUNCTION__, Logger::format("resources/ilibmanifest.json doesn't exist: %d", id.c_str()));
+    vector<string> labelFiles;
+    if (!getLabelFiles(appInfo, labelFiles)) {
+        Logger::warning(getClassName(), __FUNCTION__, Logger::format("resources/ilibmanifest.json doesn't exist: %s", id.c_str()));
         return allLabels;
     }
 
     // read each label file (for now, all language will be loaded)
-    for (auto labelFileObj : labelFiles.items()) {
-        string labelFile = labelFileObj.asString();
-        if (labelFile.empty() || labelFile.find("strings") == string::npos)
-            continue;
-
+    for (auto& labelFile : labelFiles) {
         string language = "en";
         if (labelFile.find("/") != string::npos) {
             language = labelFile.substr(0, labelFile.find("/"));
@@ -228,4 +258,63 @@ map<string, map<string, string>> AppContents::getLabels()
     }
 
     return allLabels;
-}
\ No newline at end of file
+}
+
+/**
+ * Get label filenames (relative to resources folder) from ilibmanifest.json
+ */
+bool AppContents::getLabelFiles(JValue& appInfo, vector<string>& labelFiles)
+{
+    string folderPath;
+    JValueUtil::getValue(appInfo, "folderPath", folderPath);
+
+    string maniFilePath = File::join(File::join(folderPath, "resources"), MANIFEST_FILE_NAME);
+    JValue manifest = JDomParser::fromFile(maniFilePath.c_str());
+
+    JValue files;
+    if (!JValueUtil::getValue(manifest, "files", files) || !files.isArray()) {
+        return false;
+    }
+
+    for (auto fileObj : files.items()) {
+        string file = fileObj.asString();
+        if (file.empty() || file.find("strings") == string::npos)
+            continue;
+        labelFiles.push_back(std::move(file));
+    }
+    return true;
+}
+
+/**
+ * Fingerprint of all sources used for indexing.
+ *
+ * The app version, and modified time and size of
+ * the index file, ilibmanifest.json and label files.
+ */
+string AppContents::getFingerprint(JValue& appInfo)
+{
+    string version, folderPath, searchIndex;
+    JValueUtil::getValue(appInfo, "version", version);
+    JValueUtil::getValue(appInfo, "folderPath", folderPath);
+    JValueUtil::getValue(appInfo, "searchIndex", searchIndex);
+    string resourceFolder = File::join(folderPath, "resources");
+
+    vector<string> files = {
+        File::join(folderPath, searchIndex),
+        File::join(resourceFolder, MANIFEST_FILE_NAME)
+    };
+    vector<string> labelFiles;
+    getLabelFiles(appInfo, labelFiles);
+    for (auto& labelFile : labelFiles) {
+        files.push_back(File::join(resourceFolder, labelFile));
+    }
+
+    string fingerprint = version;
+    for (auto& file : files) {
+        time_t mtime = 0;
+        off_t size = -1;
+        File::getStatus(file, mtime, size);
+        fingerprint += Logger::format("|%s:%lld:%lld", file.c_str(), (long long) mtime, (long long) size);
+    }
+    return fingerprint;
+}
@@ -23,6 +23,8 @@
 
 #include "Category.h"
 
+#include "base/Indexer.h"
+
 #include "interface/IClassName.h"
 #include "Logger.h"
 
@@ -33,7 +35,7 @@ using namespace pbnjson;
 class AppContents : public Category
                   , public IClassName<AppContents> {
 public:
-    AppContents(string id, string name, JValue &app);
+    AppContents(string id, string name, JValue &app, IndexPriority priority = IndexPriority_NORMAL);
     virtual ~AppContents();
 
     IntentPtr generateIntent(SearchItemPtr item);
@@ -41,11 +43,12 @@ public:
     bool eraseCategory();
 
 private:
-    bool createIndexes();
-
-    map<string, map<string, string>> getLabels();
+    // called on indexer thread, use only given app info
+    static vector<SearchItemPtr> createIndexes(const string& categoryId, JValue& appInfo);
 
-    JValue m_appInfo;
+    static map<string, map<string, string>> getLabels(JValue& appInfo);
+    static bool getLabelFiles(JValue& appInfo, vector<string>& labelFiles);
+    static string getFingerprint(JValue& appInfo);
 };
 
 typedef shared_ptr<AppContents> AppContentsPtr;
@@ -21,11 +21,10 @@
 #include "util/File.h"
 #include "util/JValueUtil.h"
 
-Applications::Applications() : Category("sam.apps", "Applications")
+Applications::Applications()
+    : Category("sam.apps", "Applications")
+    , m_rebuild(true)
 {
-    // remove old items first
-    // TODO: it's better to update(replace) only updated one - needs better logic
-    Database::getInstance()->removeItem(getCategoryId());
 }
 
 Applications::~Applications()
@@ -33,11 +32,90 @@ Applications::~Applications()
 }
 
 bool Applications::addToDatabase(JValue &app)
+{
+    SearchItemPtr item = createItem(app);
+    if (!item) {
+        return false;
+    }
+    // replace if it's already exist (and forget it if failed, to try again on next sync)
+    string id = item->getKey();
+    if (!Database::getInstance()->upsertItem(item, [this, id] (bool success) {
+        if (!success) {
+            m_fingerprints.erase(id);
+        }
+    })) {
+        return false;
+    }
+    m_fingerprints[id] = getFingerprint(app);
+    return true;
+}
+
+bool Applications::syncToDatabase(JValue &apps)
+{
+    map<string, string> fingerprints;
+    vector<SearchItemPtr> all;
+    vector<SearchItemPtr> changed;
+    vector<string> removed;
+
+    // new or changed apps
+    for (auto app : apps.items()) {
+        SearchItemPtr item = createItem(app);
+        if (!item) {
+            continue;
+        }
+        string fingerprint = getFingerprint(app);
+        auto it = m_fingerprints.find(item->getKey());
+        if (it == m_fingerprints.end() || it->second != fingerprint) {
+            changed.push_back(item);
+        }
+        fingerprints[item->getKey()] = std::move(fingerprint);
+        all.push_back(item);
+    }
+
+    // disappeared apps (uninstalled or became invisible)
+    for (auto& it : m_fingerprints) {
+        if (fingerprints.find(it.first) == fingerprints.end()) {
+            removed.push_back(it.first);
+        }
+    }
+
+    auto failed = [this] (bool success) {
+        if (!success) {
+            // can't trust the diff anymore, replace all on next time
+            Logger::error(getClassName(), "syncToDatabase", "Failed to sync apps, rebuild on next sync");
+            m_rebuild = true;
+        }
+    };
+    auto db = Database::getInstance();
+
+    // stored items are unknown (left from previous run or failed), replace all at once
+    if (m_rebuild) {
+        if (!db->replaceItems(getCategoryId(), all, failed)) {
+            return false;
+        }
+        m_rebuild = false;
+        m_fingerprints = std::move(fingerprints);
+        Logger::info(getClassName(), __FUNCTION__, Logger::format("Rebuilt: %zu apps", m_fingerprints.size()));
+        return true;
+    }
+
+    if ((!removed.empty() && !db->removeItems(getCategoryId(), removed, failed)) ||
+        (!changed.empty() && !db->upsertItems(changed, failed))) {
+        failed(false);
+        return false;
+    }
+
+    m_fingerprints = std::move(fingerprints);
+    Logger::info(getClassName(), __FUNCTION__, Logger::format("Synced: %zu changed, %zu removed, %zu apps", changed.size(), removed.size(), m_fingerprints.size()));
+    return true;
+}
+
+SearchItemPtr Applications::createItem(JValue &app)
 {
     bool visible;
     if (JValueUtil::getValue(app, "visible", visible) && !visible) {
         // ignore non-visible apps
-        return false;
+        return nullptr;
     }
 
     string id, title, icon, folderPath;
@@ -50,9 +128,8 @@ bool Applications::addToDatabase(JValue &app)
     display.put("title", title);
     display.put("icon", File::join(folderPath, icon));
 
-    // create search item and insert
-    SearchItemPtr item = make_shared<SearchItem>(getCategoryId(), id, title, display);
-    return Database::getInstance()->insertItem(item);
+    // create search item
+    return make_shared<SearchItem>(getCategoryId(), id, title, display);
 }
 
 IntentPtr Applications::generateIntent(SearchItemPtr item)
@@ -76,5 +153,34 @@ IntentPtr Applications::generateIntent(SearchItemPtr item)
 
 bool Applications::removeFromDatabase(string id)
 {
+    if (id.empty()) {
+        m_fingerprints.clear();
+    } else {
+        m_fingerprints.erase(id);
+    }
     return Database::getInstance()->removeItem(getCategoryId(), id);
+}
+
+bool Applications::removeFromDatabase(const vector<string>& ids)
+{
+    for (auto& id : ids) {
+        m_fingerprints.erase(id);
+    }
+    return Database::getInstance()->removeItems(getCategoryId(), ids);
+}
+
+/**
+ * Fingerprint of the app properties stored in the search item.
+ * The item needs to be updated only when this is changed.
+ */
+string Applications::getFingerprint(JValue &app)
+{
+    string fingerprint;
+    for (auto key : { "id", "version", "title", "icon", "folderPath" }) {
+        string value;
+        JValueUtil::getValue(app, key, value);
+        fingerprint += value;
+        fingerprint += '\n';
+    }
+    return fingerprint;
 }
\ No newline at end of file
@@ -19,6 +19,7 @@
 
 #include <luna-service2/lunaservice.hpp>
 #include <pbnjson.hpp>
+#include <map>
 
 #include "Category.h"
 
@@ -36,9 +37,20 @@ public:
     virtual ~Applications();
 
     bool addToDatabase(JValue &app);
+    bool syncToDatabase(JValue &apps);
     bool removeFromDatabase(string id = "");
+    bool removeFromDatabase(const vector<string>& ids);
 
     IntentPtr generateIntent(SearchItemPtr item);
+
+private:
+    SearchItemPtr createItem(JValue &app);
+    string getFingerprint(JValue &app);
+
+    // app id => fingerprint of the stored item
+    map<string, string> m_fingerprints;
+    // replace whole category on next sync
+    bool m_rebuild;
 };
 
 typedef shared_ptr<Applications> ApplicationsPtr;
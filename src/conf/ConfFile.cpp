@@ -58,6 +58,89 @@ const string& ConfFile::getRespawnedPath()
     return RespawnedPath;
 }
 
+int ConfFile::getCacheMaxEntries()
+{
+    static int CacheMaxEntries = 64;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "cacheMaxEntries", CacheMaxEntries);
+    return CacheMaxEntries;
+}
+
+int ConfFile::getCacheMaxBytes()
+{
+    static int CacheMaxBytes = 1024 * 1024;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "cacheMaxBytes", CacheMaxBytes);
+    return CacheMaxBytes;
+}
+
+int ConfFile::getCacheTTL()
+{
+    // seconds, for sources not telling their changes (e.g. DB8)
+    static int CacheTTL = 30;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "cacheTTL", CacheTTL);
+    return CacheTTL;
+}
+
+int ConfFile::getSearchTimeout()
+{
+    static int SearchTimeout = 2000;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "timeoutMs", SearchTimeout);
+    return SearchTimeout;
+}
+
+const string& ConfFile::getJournalMode()
+{
+    // WAL lets searches read while items are written
+    static string JournalMode = "WAL";
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "journalMode", JournalMode);
+    return JournalMode;
+}
+
+const string& ConfFile::getSynchronous()
+{
+    static string Synchronous = "NORMAL";
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "synchronous", Synchronous);
+    return Synchronous;
+}
+
+int ConfFile::getCacheSize()
+{
+    // pages, or KiB if it's negative (same as PRAGMA cache_size)
+    static int CacheSize = -2048;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "cacheSize", CacheSize);
+    return CacheSize;
+}
+
+int ConfFile::getMmapSize()
+{
+    // bytes (0 = disabled)
+    static int MmapSize = 0;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "mmapSize", MmapSize);
+    return MmapSize;
+}
+
+const string& ConfFile::getTempStore()
+{
+    static string TempStore = "MEMORY";
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "tempStore", TempStore);
+    return TempStore;
+}
+
+int ConfFile::getMaintenanceInterval()
+{
+    // seconds
+    static int MaintenanceInterval = 60;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "maintenanceInterval", MaintenanceInterval);
+    return MaintenanceInterval;
+}
+
+int ConfFile::getMaintenanceBudget()
+{
+    // milliseconds of the writer thread for each step
+    static int MaintenanceBudget = 50;
+    JValueUtil::getValue(m_readOnlyDatabase, "search", "maintenanceBudgetMs", MaintenanceBudget);
+    return MaintenanceBudget;
+}
+
 void ConfFile::loadReadOnlyConf()
 {
     m_readOnlyDatabase = JDomParser::fromFile(PATH_RO_SEARCH_CONF);
@@ -50,6 +50,25 @@ public:
     const string& getRespawnedPath();
     const string& getLoginBrokerEnablerPath();
 
+    // search result cache (0 = disabled)
+    int getCacheMaxEntries();
+    int getCacheMaxBytes();
+    int getCacheTTL();
+
+    // milliseconds to wait all sources for a search (0 = no limit)
+    int getSearchTimeout();
+
+    // SQLite pragmas applied when the database is opened
+    const string& getJournalMode();
+    const string& getSynchronous();
+    int getCacheSize();
+    int getMmapSize();
+    const string& getTempStore();
+
+    // idle maintenance of the database (0 = disabled), and time for each step
+    int getMaintenanceInterval();
+    int getMaintenanceBudget();
+
     /** READ WRIETE CONFIGS **/
 
 private:
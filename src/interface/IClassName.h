@@ -20,33 +20,34 @@
 #include <string>
 #include <cstdlib>
 #include <cxxabi.h>
+#include <typeinfo>
 
 using namespace std;
 
 template<class T>
 class IClassName {
 public:
-    IClassName() {
-        int status;
-        s_name = typeid(T).name();
-        char *demangled_name = abi::__cxa_demangle(s_name.c_str(), NULL, NULL, &status);
-        std::string d_name(demangled_name ? demangled_name : "");
-        if (status == 0) {
-            s_name = std::move(d_name);
-            std::free(demangled_name);
-        }
-    }
+    IClassName() {}
 
+    // made once (thread-safe), it's read by worker threads also
     static const string& getClassName()
     {
+        static const string s_name = demangle();
         return s_name;
     }
 
 private:
-    static string s_name;
+    static string demangle()
+    {
+        int status;
+        string name = typeid(T).name();
+        char *demangled_name = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+        if (status == 0 && demangled_name) {
+            name = demangled_name;
+        }
+        std::free(demangled_name);
+        return name;
+    }
 };
 
-template<class T>
-string IClassName<T>::s_name = "";
-
 #endif /* INTERFACE_ICLASSNAME_H_ */
@@ -111,6 +111,18 @@ bool File::isFile(const string& path)
     return true;
 }
 
+bool File::getStatus(const string& path, time_t& mtime, off_t& size)
+{
+    struct stat fileStat;
+
+    if (stat(path.c_str(), &fileStat) != 0) {
+        return false;
+    }
+    mtime = fileStat.st_mtime;
+    size = fileStat.st_size;
+    return true;
+}
+
 bool File::createDir(const string& path)
 {
     const char* path_str = path.c_str();
@@ -36,6 +36,7 @@ public:
 
     static bool isDirectory(const string& path);
     static bool isFile(const string& path);
+    static bool getStatus(const string& path, time_t& mtime, off_t& size);
     static bool createDir(const string& path);
     static bool createFile(const string& path);
 
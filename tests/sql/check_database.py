@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""
+SQLite level checks of src/base/Database.cpp, without the service.
+
+Queries are read from the source itself (tableQueries, statementQueries and
+migrationQueries), so they're checked as they're built:
+  - migration chain from the first (FTS3) file to the latest schema
+  - paging ITEM_SELECT by cursors gives the same rows as one query
+  - DATA_COLLECT removes values not referred, also when some refs are NULL
+
+Needs SQLite with FTS3, FTS5 and JSON1 (python3 built-in module is enough).
+Usage: python3 tests/sql/check_database.py [path/to/Database.cpp]
+"""
+
+import json
+import os
+import re
+import sqlite3
+import sys
+
+SOURCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'src', 'base', 'Database.cpp')
+
+# first file, before any migration (user_version 0)
+BASELINE_TABLE = 'CREATE VIRTUAL TABLE Items USING FTS3(category, key, text, display, extra);'
+
+
+def read_queries(source, name):
+    """Entries of 'static const map<..., string> name = { ... };' as a dict"""
+    match = re.search(r'static const map<(int|string), string> ' + name + r' = \{(.*?)\n\};', source, re.S)
+    if not match:
+        raise RuntimeError('%s is not found' % name)
+    body = re.sub(r'^\s*//.*$', '', match.group(2), flags=re.M)
+    queries = {}
+    for entry in re.finditer(r'\{\s*(\d+|"[A-Z_]+")\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)\}', body):
+        key = int(entry.group(1)) if match.group(1) == 'int' else entry.group(1).strip('"')
+        queries[key] = ''.join(re.findall(r'"((?:[^"\\]|\\.)*)"', entry.group(2)))
+    return queries
+
+
+def fnv1a(value):
+    """Same as fnv1a() of Database.cpp (64 bits, signed as sqlite3_int64)"""
+    if value is None:
+        return None
+    hash = 14695981039346656037
+    for byte in value.encode('utf-8'):
+        hash ^= byte
+        hash = (hash * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return hash - (1 << 64) if hash >= (1 << 63) else hash
+
+
+def connect():
+    db = sqlite3.connect(':memory:', isolation_level=None)
+    db.create_function('fnv1a', 1, fnv1a, deterministic=True)
+    return db
+
+
+def create_tables(db, tables):
+    for query in tables.values():
+        db.execute(query)
+
+
+def migrate(db, migrations):
+    """Same as Database::migrate(), each version is one transaction"""
+    version = db.execute('PRAGMA user_version;').fetchone()[0]
+    for to, query in sorted(migrations.items()):
+        if to <= version:
+            continue
+        db.executescript('BEGIN;' + query + 'PRAGMA user_version = %d;' % to + 'COMMIT;')
+        version = to
+    return version
+
+
+def insert(db, statements, category, key, text, display, extra):
+    """Same as Database::bindItem()"""
+    def store(value):
+        hash = fnv1a(value)
+        for id, stored in db.execute(statements['DATA_SELECT'], (hash,)):
+            if stored == value:
+                return id
+        return db.execute(statements['DATA_INSERT'], (hash, value)).lastrowid
+
+    display_id = store(display)
+    extra_id = store(extra)
+    db.execute(statements['CATE_ID_INSERT'], (category,))
+    rowid = db.execute(statements['ITEM_INSERT'], (text,)).lastrowid
+    db.execute(statements['KEY_INSERT'], (rowid, category, key, display_id, extra_id))
+
+
+def search(db, statements, match, categories=None, max_items=0, limit=-1, cursor=None):
+    params = [match, json.dumps(categories) if categories else None, max_items, limit]
+    params += list(cursor) if cursor else [None, None, None]
+    return db.execute(statements['ITEM_SELECT'], params).fetchall()
+
+
+def search_pages(db, statements, match, categories, max_items, page):
+    """Same as next pages of Database::searchChunks(), cursor is given as a string"""
+    rows, cursor = [], None
+    while True:
+        part = search(db, statements, match, categories, max_items, page, cursor)
+        rows += part
+        if len(part) < page:
+            return rows
+        crank, score, rowid = part[-1][5:8]
+        text = '%d,%.17g,%d' % (crank, score, rowid)
+        crank, score, rowid = text.split(',')
+        cursor = (int(crank), float(score), int(rowid))
+
+
+def check(condition, message):
+    if not condition:
+        raise AssertionError(message)
+    print('ok - ' + message)
+
+
+def check_migration(tables, statements, migrations):
+    db = connect()
+    db.execute(BASELINE_TABLE)
+    items = [
+        ('com.app', 'app1', 'Alpha Music', '{"icon":"a.png"}', None),
+        ('com.app', 'app2', 'Alpine Video', '{"icon":"a.png"}', '{"id":"app2"}'),
+        ('com.media', '/a.mp3', 'Alpha Song', '{"title":"Alpha Song"}', '{"id":"app2"}'),
+        ('com.media', '/b.mp3', 'Beta Song', '{"title":"Beta Song"}', None),
+    ]
+    db.executemany('INSERT INTO Items values (?, ?, ?, ?, ?);', items)
+
+    version = migrate(db, migrations)
+    create_tables(db, tables)
+    check(version == max(migrations), 'migrated to v%d' % version)
+
+    migrated = db.execute('SELECT Names.name, Keys.key, Items.text, Display.value, Extra.value FROM ItemKeys AS Keys '
+                          'JOIN Items ON Items.rowid = Keys.id JOIN CategoryIds AS Names ON Names.id = Keys.category '
+                          'LEFT JOIN ItemData AS Display ON Display.id = Keys.display '
+                          'LEFT JOIN ItemData AS Extra ON Extra.id = Keys.extra ORDER BY Keys.id;').fetchall()
+    check(migrated == items, 'items are kept by the migration')
+
+    count = db.execute('SELECT count(*) FROM ItemData;').fetchone()[0]
+    check(count == 4, 'same display/extra are stored once (%d values)' % count)
+
+    found = search(db, statements, '"alp"*')
+    check(sorted(row[1] for row in found) == ['/a.mp3', 'app1', 'app2'], 'migrated items are searched')
+
+    # once more, it's done already
+    check(migrate(db, migrations) == version, 'migration is not done again')
+
+
+def check_cursor(tables, statements):
+    db = connect()
+    create_tables(db, tables)
+    categories = ['com.c', 'com.a', 'com.b']
+    for i in range(40):
+        category = categories[i % 3]
+        # same text makes same scores, order of them is kept by rowid
+        text = 'song %d' % (i % 4) if i % 5 else 'song song %d' % i
+        insert(db, statements, category, 'key%d' % i, text, '{"n":%d}' % i, '')
+
+    for order, max_items in ((None, 0), (categories, 0), (['com.b', 'com.c'], 7)):
+        full = search(db, statements, '"son"*', order, max_items)
+        for page in (1, 4, 9):
+            paged = search_pages(db, statements, '"son"*', order, max_items, page)
+            check(paged == full, 'pages of %d are same as one search (categories %s, maxItems %d, %d rows)'
+                  % (page, order, max_items, len(full)))
+
+    ranked = [row[0] for row in search(db, statements, '"son"*', categories)]
+    check(ranked == sorted(ranked, key=categories.index), 'results are in the order of categories')
+
+
+def check_collect(tables, statements):
+    db = connect()
+    create_tables(db, tables)
+    insert(db, statements, 'com.app', 'app1', 'Alpha', '{"icon":"a.png"}', '')
+    insert(db, statements, 'com.app', 'app2', 'Beta', '{"icon":"b.png"}', '')
+    db.execute('UPDATE ItemKeys SET extra = NULL WHERE key = ?;', ('app1',))
+    db.execute(statements['ITEM_DELETE_KEY'], ('com.app', 'app2'))
+    db.execute(statements['KEY_DELETE_KEY'], ('com.app', 'app2'))
+
+    db.execute(statements['DATA_COLLECT'], (64,))
+    values = sorted(row[0] for row in db.execute('SELECT value FROM ItemData;'))
+    check(values == ['{"icon":"a.png"}'], 'values not referred are collected, also with NULL refs')
+
+
+def main():
+    with open(sys.argv[1] if len(sys.argv) > 1 else SOURCE) as file:
+        source = file.read()
+    tables = read_queries(source, 'tableQueries')
+    statements = read_queries(source, 'statementQueries')
+    migrations = read_queries(source, 'migrationQueries')
+
+    check_migration(tables, statements, migrations)
+    check_cursor(tables, statements)
+    check_collect(tables, statements)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())